@@ -7,10 +7,16 @@
     * This file provides a thread-safe queue that allows multiple producers and ONE consumer.
     * It is designed to have a dequeue API different from the OG queue API
     * which fetches all values enqueued since the last dequeue call at once.
+    *
+    * The queue owns a ring of Depth buffers: two take turns receiving values from producers,
+    * the rest are spares. Every non-empty dequeue swaps a spare in and hands the filled buffer out
+    * as a batch, which returns it to the spares when destroyed (on any thread).
+    * So the consumer can hold up to Depth - 2 batches at once, e.g. execute one while fetching the next.
 */
 
 #include <concepts>
 #include <cstddef>
+#include <cstdint>
 
 #include <iterator>
 #include <ranges>
@@ -19,7 +25,20 @@
 #include <atomic>
 #include <thread>
 #include <memory>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
 #include <cassert>
+#include <chrono>
+
+#if defined(__linux__)
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "trace.hpp"
 
 namespace mylib {
 
@@ -33,6 +52,18 @@ namespace mylib {
     
         inline constexpr std::size_t queue_align = std::hardware_destructive_interference_size;
 
+#if defined(__linux__)
+        // std::atomic::wait has no timeout, so parking talks to the futex directly.
+        // Waking must do the same, libstdc++ skips notify when it saw no waiter of its own.
+        inline void futex_wait(std::atomic_uint32_t& word, std::uint32_t expected, const ::timespec* timeout) noexcept {
+            ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT_PRIVATE, expected, timeout, nullptr, 0);
+        }
+
+        inline void futex_wake_one(std::atomic_uint32_t& word) noexcept {
+            ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+        }
+#endif
+
         struct alignas(queue_align) queue_head
         {
             const std::size_t capacity;
@@ -45,6 +76,7 @@ namespace mylib {
         struct alignas(queue_align) queue_cell
         {
             T value;
+            [[no_unique_address]] trace::flow flow;
         };
 
         template<typename T>
@@ -65,21 +97,49 @@ namespace mylib {
 
             bool full() const noexcept { return this->leaving_counter.load(std::memory_order_relaxed) >= capacity(); }
 
-            bool enqueue(std::size_t queue_number, value_type&& v) noexcept {
+            bool ready(std::size_t total_candidates) const noexcept {
+                return this->leaving_counter.load(std::memory_order_relaxed) >= total_candidates;
+            }
+
+            bool enqueue(std::size_t queue_number, value_type&& v, trace::flow flow) noexcept {
                 defer _([this] { this->leaving_counter.fetch_add(1, std::memory_order_release); });
                 if (queue_number >= capacity()) {
                     return false;
                 }
-                std::ranges::swap(v, storage()[queue_number].value);
+                cell_type& cell = storage()[queue_number];
+                std::ranges::swap(v, cell.value);
+                cell.flow = flow;
                 return true;
             }
 
+            // Writes values make(0) ... make(n - 1) starting at first_number, where n is the number of cells left.
+            // All count tokens are published at once.
+            template<typename F>
+            std::size_t enqueue_bulk(std::size_t first_number, std::size_t count, F& make, trace::flow flow) noexcept {
+                defer _([this, count] { this->leaving_counter.fetch_add(count, std::memory_order_release); });
+                if (first_number >= capacity()) {
+                    return 0;
+                }
+                const std::size_t accepted = std::min(count, capacity() - first_number);
+                const auto cells = storage().subspan(first_number, accepted);
+                for (std::size_t i = 0; i < accepted; ++i) {
+                    value_type v = make(i);
+                    std::ranges::swap(v, cells[i].value);
+                    cells[i].flow = flow.at(i);
+                }
+                return accepted;
+            }
+
             std::span<cell_type> wait_for_exclusive_values(std::size_t total_candidates) noexcept {
                 while (this->leaving_counter.load(std::memory_order_acquire) < total_candidates) {
                     std::this_thread::yield(); // TODO: maybe do something else while waiting?
                 }
                 this->leaving_counter.store(0, std::memory_order_relaxed);
                 this->queue_head::size = std::min(total_candidates, capacity());
+                return values();
+            }
+
+            std::span<cell_type> values() noexcept {
                 return storage().subspan(0, size());
             }
 
@@ -123,14 +183,19 @@ namespace mylib {
         
     } // namespace details
 
-    template<typename T>
+    template<typename T, std::size_t Depth = 3>
     class alignas(std::hardware_constructive_interference_size) concurrent_queue
     {
+        static_assert(Depth >= 3, "Two buffers for producers and at least one for the consumer");
     public:
         using value_type = T;
+        constexpr static std::size_t depth = Depth;
         using queue_unit_type = details::queue_buffer<value_type>;
         using queue_unit_handle_type = std::unique_ptr<queue_unit_type>;
         constexpr static std::size_t top_bit_mask = ~((~0uz) >> 1);
+        // set in entering_counter while a drain or steal is handing the current buffer over
+        constexpr static std::size_t busy_bit_mask = top_bit_mask >> 1;
+        constexpr static std::size_t counter_mask = ~(top_bit_mask | busy_bit_mask);
     private:
         using cell_type = details::queue_cell<value_type>;
     public:
@@ -154,6 +219,8 @@ namespace mylib {
 
                 value_type& operator*() const noexcept { return original->value; }
                 value_type& operator[](difference_type i) const noexcept { return (original + i)->value; }
+                // Id that follows the value from its enqueue, see trace::flow.
+                trace::flow flow() const noexcept { return original->flow; }
 
                 iterator& operator++() noexcept { ++original; return *this; }
                 iterator operator++(int) noexcept { iterator cached = *this; ++*this; return cached; }
@@ -194,76 +261,309 @@ namespace mylib {
 
         static_assert(std::ranges::random_access_range<values_view>);
 
+        // Owns a drained buffer until destroyed or released, must not outlive the queue.
+        class [[nodiscard("Contents of queue should be consumed.")]] batch
+        {
+        public:
+            using iterator = typename values_view::iterator;
+
+            batch() = default;
+            batch(const batch&) = delete;
+            batch& operator=(const batch&) = delete;
+
+            batch(batch&& other) noexcept
+                : owner(std::exchange(other.owner, nullptr)), buffer(std::exchange(other.buffer, nullptr))
+            {}
+
+            batch& operator=(batch&& other) noexcept {
+                if (this != &other) {
+                    this->release();
+                    this->owner = std::exchange(other.owner, nullptr);
+                    this->buffer = std::exchange(other.buffer, nullptr);
+                }
+                return *this;
+            }
+
+            ~batch() { this->release(); }
+
+            values_view values() const noexcept {
+                return this->buffer ? values_view(this->buffer->values()) : values_view();
+            }
+
+            iterator begin() const noexcept { return this->values().begin(); }
+            iterator end() const noexcept { return this->values().end(); }
+            std::size_t size() const noexcept { return this->buffer ? this->buffer->size() : 0; }
+            bool empty() const noexcept { return this->size() == 0; }
+            value_type& operator[](std::size_t i) const noexcept { return this->begin()[i]; }
+
+            // Any thread, hands the buffer back to the queue it came from.
+            void release() noexcept {
+                if (this->buffer) {
+                    this->owner->put_spare(this->buffer);
+                    this->owner = nullptr;
+                    this->buffer = nullptr;
+                }
+            }
+
+        private:
+            friend concurrent_queue;
+            batch(concurrent_queue* owner, queue_unit_type* buffer) noexcept : owner(owner), buffer(buffer) {}
+
+            concurrent_queue* owner = nullptr;
+            queue_unit_type* buffer = nullptr;
+        };
+
+        static_assert(std::ranges::random_access_range<batch>);
+
         concurrent_queue() = delete;
         concurrent_queue(const concurrent_queue&) = delete;
         concurrent_queue& operator=(const concurrent_queue&) = delete;
         concurrent_queue(concurrent_queue&&) = delete;
         concurrent_queue& operator=(concurrent_queue&&) = delete;
 
-        explicit concurrent_queue(std::size_t capacity)
-            : queue_handles{
-                queue_unit_type::make(capacity),
-                queue_unit_type::make(capacity),
-                queue_unit_type::make(capacity)
+        explicit concurrent_queue(std::size_t capacity) {
+            for (auto& handle : this->queue_handles) {
+                handle.store(queue_unit_type::make(capacity).release(), std::memory_order_relaxed);
             }
-        {}
+            for (auto& spare : this->spare_handles) {
+                spare.store(queue_unit_type::make(capacity).release(), std::memory_order_relaxed);
+            }
+        }
+
+        // Before the queue is shared, for consumers that record an execute event per value with the value's
+        // flow (values_view::iterator::flow). Otherwise the flow starts recorded by enqueue would never end.
+        void trace_flows() noexcept { this->flows = true; }
+
+        // Every batch must have been released.
+        ~concurrent_queue() {
+            for (auto& handle : this->queue_handles) {
+                delete handle.load(std::memory_order_relaxed);
+            }
+            for (auto& spare : this->spare_handles) {
+                queue_unit_type* const buffer = spare.load(std::memory_order_relaxed);
+                assert(buffer != nullptr && "A batch outlived its queue");
+                delete buffer;
+            }
+        }
 
         bool enqueue(value_type&& v) noexcept {
             if (this->full_flag.load(std::memory_order_relaxed)) {
                 return false;
             }
-            const auto queue_token = this->entering_counter.fetch_add(1, std::memory_order_relaxed);
+            const auto begin = trace::now();
+            const auto flow = trace::enabled && this->flows ? trace::reserve_flows(1) : trace::flow{};
+            // acquire: the buffer installed by the last handoff of this slot
+            const auto queue_token = this->entering_counter.fetch_add(1, std::memory_order_acquire);
             const auto queue_index = queue_token & top_bit_mask;
-            const auto queue_number = queue_token & ~top_bit_mask;
-            const bool result = this->queue_handles[queue_index ? 1 : 0]->enqueue(queue_number, std::move(v));
+            const auto queue_number = queue_token & counter_mask;
+            const bool result = this->handle_at(queue_index)->enqueue(queue_number, std::move(v), flow);
             if (!result) {
                 this->full_flag.store(true, std::memory_order_relaxed);
+            } else {
+                trace::record(trace::event_kind::enqueue, this, 1, begin, trace::now(), flow);
+            }
+            if (queue_number == 0) {
+                // empty -> non-empty, the only enqueue that may have to wake the consumer
+                this->notify_parked();
             }
             return result;
         }
 
-        values_view wait_for_exclusive_values() noexcept {
-            while (stealing_lock.test_and_set(std::memory_order_acquire)) {
-                std::this_thread::yield();
+        // Reserves count tokens with one RMW and publishes them with another.
+        // Returns the number of values accepted, make(i) is only called for i below that number.
+        template<typename F>
+            requires std::is_nothrow_invocable_r_v<value_type, F&, std::size_t>
+        std::size_t enqueue_bulk(std::size_t count, F&& make) noexcept {
+            if (count == 0 || this->full_flag.load(std::memory_order_relaxed)) {
+                return 0;
             }
-            details::defer _([this] { this->stealing_lock.clear(std::memory_order_release); });
+            const auto begin = trace::now();
+            const auto flow = trace::enabled && this->flows ? trace::reserve_flows(count) : trace::flow{};
+            const auto queue_token = this->entering_counter.fetch_add(count, std::memory_order_acquire);
+            const auto queue_index = queue_token & top_bit_mask;
+            const auto queue_number = queue_token & counter_mask;
+            const auto accepted = this->handle_at(queue_index)->enqueue_bulk(queue_number, count, make, flow);
+            if (accepted < count) {
+                this->full_flag.store(true, std::memory_order_relaxed);
+            }
+            if (accepted != 0) {
+                trace::record(trace::event_kind::enqueue, this, accepted, begin, trace::now(), flow);
+            }
+            if (queue_number == 0) {
+                this->notify_parked();
+            }
+            return accepted;
+        }
 
-            auto [queue_handle, total_candidates] = this->fetch_current_handle();
-            values_view result(queue_handle->wait_for_exclusive_values(total_candidates));
-            std::ranges::swap(queue_handle, this->queue_handles[2]);
-            return result;
+        // Consumer only, idle protocol (event count):
+        //     auto ticket = queue.prepare_park();
+        //     if (/* found other work */) { queue.cancel_park(); } else { queue.park(ticket); }
+        // park_until gives up at deadline, for consumers that have a timer of their own.
+        // Any value enqueued after prepare_park returns either makes park return immediately,
+        // or wakes it up. Only the enqueue that makes the queue non-empty checks for a parked consumer.
+        using park_ticket = std::uint32_t;
+
+        bool empty() const noexcept {
+            return (this->entering_counter.load(std::memory_order_relaxed) & counter_mask) == 0;
+        }
+
+        park_ticket prepare_park() noexcept {
+            const auto ticket = this->idle_epoch.load(std::memory_order_acquire);
+            this->parked.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            return ticket;
+        }
+
+        void cancel_park() noexcept {
+            this->parked.store(false, std::memory_order_relaxed);
+        }
+
+        void park(park_ticket ticket) noexcept {
+#if defined(__linux__)
+            while (this->empty() && this->idle_epoch.load(std::memory_order_acquire) == ticket) {
+                details::futex_wait(this->idle_epoch, ticket, nullptr);
+            }
+#else
+            if (this->empty()) {
+                this->idle_epoch.wait(ticket, std::memory_order_acquire);
+            }
+#endif
+            this->parked.store(false, std::memory_order_relaxed);
         }
 
-        values_view steal(concurrent_queue& other) noexcept {
-            if (other.stealing_lock.test_and_set(std::memory_order_acquire)) {
-                return values_view();
+        template<typename Clock, typename Duration>
+        void park_until(park_ticket ticket, const std::chrono::time_point<Clock, Duration>& deadline) noexcept {
+            while (this->empty() && this->idle_epoch.load(std::memory_order_acquire) == ticket) {
+                const auto now = Clock::now();
+                if (now >= deadline) {
+                    break;
+                }
+#if defined(__linux__)
+                const auto left = std::chrono::ceil<std::chrono::nanoseconds>(deadline - now).count();
+                const ::timespec timeout{ static_cast<std::time_t>(left / 1'000'000'000), static_cast<long>(left % 1'000'000'000) };
+                details::futex_wait(this->idle_epoch, ticket, &timeout);
+#else
+                // no timed wait on std::atomic, sleep in short steps
+                std::this_thread::sleep_for(std::min<typename Clock::duration>(deadline - now, std::chrono::milliseconds(1)));
+#endif
             }
-            details::defer _([&other] { other.stealing_lock.clear(std::memory_order_release); });
+            this->parked.store(false, std::memory_order_relaxed);
+        }
 
-            auto [other_handle, total_candidates] = other.fetch_current_handle();
-            values_view result(other_handle->wait_for_exclusive_values(total_candidates));
-            std::ranges::swap(other_handle, this->queue_handles[2]);
+        // Any thread, wakes the consumer whether or not this queue has values.
+        void wake() noexcept {
+            this->idle_epoch.fetch_add(1, std::memory_order_release);
+#if defined(__linux__)
+            details::futex_wake_one(this->idle_epoch);
+#else
+            this->idle_epoch.notify_one();
+#endif
+        }
+
+        // Returns an empty batch without touching the queue when Depth - 2 batches are still held,
+        // or when a thief is handing the current buffer over right now (it takes the values instead).
+        batch wait_for_exclusive_values() noexcept {
+            trace::span draining(trace::event_kind::drain, this);
+            batch result = this->take_current(*this);
+            draining.set_count(result.size());
+            return result;
+        }
+
+        // Takes the current buffer of other, a spare of this queue goes into its place.
+        // Never waits for the owner or other thieves, fails at once so the next victim can be tried.
+        batch steal(concurrent_queue& other) noexcept {
+            trace::span stealing(trace::event_kind::steal, &other);
+            batch result = this->take_current(other);
+            stealing.set_count(result.size());
             return result;
         }
 
     private:
-        struct fetch_result {
-            queue_unit_handle_type& handle;
-            std::size_t total_candidates;
-        };
-        
-        fetch_result fetch_current_handle() noexcept {
-            const auto curr = this->entering_counter.load(std::memory_order_relaxed) & top_bit_mask;
-            const auto next = curr ^ top_bit_mask;
-            const auto final_result = this->entering_counter.exchange(next, std::memory_order_relaxed);
-            this->full_flag.store(false, std::memory_order_relaxed);
-            return { this->queue_handles[curr ? 1 : 0], final_result & ~top_bit_mask };
+        queue_unit_type* handle_at(std::size_t queue_index) const noexcept {
+            return this->queue_handles[queue_index ? 1 : 0].load(std::memory_order_relaxed);
+        }
+
+        // Wait-free handoff, whoever sets busy_bit_mask owns the epoch flip of source
+        // until the buffer of the closed epoch is replaced by a spare of this queue.
+        // Only the wait for producers that already hold a token of that epoch remains.
+        batch take_current(concurrent_queue& source) noexcept {
+            queue_unit_type* const spare = this->take_spare();
+            if (spare == nullptr) {
+                return batch();
+            }
+            if (source.entering_counter.fetch_or(busy_bit_mask, std::memory_order_acquire) & busy_bit_mask) {
+                this->put_spare(spare);
+                return batch();
+            }
+            const auto curr = source.entering_counter.load(std::memory_order_relaxed) & top_bit_mask;
+            const auto next = (curr ^ top_bit_mask) | busy_bit_mask;
+            const auto final_result = source.entering_counter.exchange(next, std::memory_order_relaxed);
+            source.full_flag.store(false, std::memory_order_relaxed);
+
+            auto& handle = source.queue_handles[curr ? 1 : 0];
+            queue_unit_type* const filled = handle.load(std::memory_order_relaxed);
+            wait_for_handle(*filled, final_result & counter_mask, &source);
+            batch result;
+            if (filled->size() == 0) {
+                // an empty buffer simply stays where it is, no need to spend a spare on it
+                this->put_spare(spare);
+            } else {
+                handle.store(spare, std::memory_order_relaxed);
+                result = batch(this, filled);
+            }
+            // publishes the new buffer to the next handoff and to producers of the next epoch
+            source.entering_counter.fetch_and(~busy_bit_mask, std::memory_order_release);
+            return result;
+        }
+
+        queue_unit_type* take_spare() noexcept {
+            for (auto& spare : this->spare_handles) {
+                if (spare.load(std::memory_order_relaxed) != nullptr) {
+                    if (auto* const buffer = spare.exchange(nullptr, std::memory_order_acquire)) {
+                        return buffer;
+                    }
+                }
+            }
+            return nullptr;
+        }
+
+        // The number of buffers is fixed, so there is always a free slot.
+        void put_spare(queue_unit_type* buffer) noexcept {
+            while (true) {
+                for (auto& spare : this->spare_handles) {
+                    queue_unit_type* expected = nullptr;
+                    if (spare.compare_exchange_strong(expected, buffer, std::memory_order_release, std::memory_order_relaxed)) {
+                        return;
+                    }
+                }
+            }
+        }
+
+        static std::span<cell_type> wait_for_handle(queue_unit_type& handle, std::size_t total_candidates, const concurrent_queue* owner) noexcept {
+            if constexpr (trace::enabled) {
+                if (!handle.ready(total_candidates)) {
+                    trace::span waiting(trace::event_kind::wait, owner);
+                    return handle.wait_for_exclusive_values(total_candidates);
+                }
+            }
+            return handle.wait_for_exclusive_values(total_candidates);
+        }
+
+        void notify_parked() noexcept {
+            // pairs with the fence in prepare_park
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (this->parked.load(std::memory_order_relaxed) && this->parked.exchange(false, std::memory_order_relaxed)) {
+                this->wake();
+            }
         }
 
-        std::array<queue_unit_handle_type, 3> queue_handles;
+        std::array<std::atomic<queue_unit_type*>, 2> queue_handles;
+        std::array<std::atomic<queue_unit_type*>, Depth - 2> spare_handles;
         std::atomic_size_t entering_counter = 0;
-        std::atomic_flag stealing_lock = {};
         std::atomic_bool full_flag = false;
+        std::atomic_bool parked = false;
+        bool flows = false;
+        std::atomic_uint32_t idle_epoch = 0;
     };
 
     static_assert(sizeof(concurrent_queue<std::size_t>) <= std::hardware_constructive_interference_size);
@@ -0,0 +1,643 @@
+#ifndef MYLIB_IO_REACTOR_H
+#define MYLIB_IO_REACTOR_H 1
+
+/*
+    * Header file for I/O reactor feeding thread_worker queues (Linux only)
+    *
+    * Jobs submit reads and writes and return, the continuation runs later as a value on the owning worker.
+    * Submissions go through an MPSC concurrent_queue to the reactor thread,
+    * which hands them to io_uring (raw syscalls, no liburing) or, when io_uring is unavailable, to epoll.
+    * Completions are reaped in batches, grouped by owner and published with one threadpool::submit_bulk_to per owner
+    * (so a continuation whose owner has retired is still picked up by the survivors),
+    * so delivery is amortized the same way wait_for_exclusive_values amortizes consumption.
+    *
+    * The epoll backend performs the read / write on the reactor thread once the fd is ready,
+    * fds that cannot be polled (regular files) are served synchronously there.
+    * Writes bigger than the free space of a blocking pipe would stall the reactor, use O_NONBLOCK fds.
+*/
+
+#ifdef __linux__
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <cerrno>
+#include <linux/io_uring.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "concurrent_queue.hpp"
+#include "thread_worker.hpp"
+#include "threadpool.hpp"
+
+namespace mylib {
+
+    enum class io_backend
+    {
+        automatic,  // io_uring if the kernel allows it, epoll otherwise
+        io_uring,
+        epoll,
+    };
+
+    namespace details {
+
+        struct io_request
+        {
+            enum class kind : std::uint8_t { read, write };
+
+            io_request(const io_request&) = delete;
+            io_request& operator=(const io_request&) = delete;
+            virtual ~io_request() = default;
+
+            // Runs the continuation with result and deletes this.
+            virtual void complete() = 0;
+
+            int fd;
+            kind op;
+            void* buffer;
+            std::size_t length;
+            std::int64_t offset;
+            void* owner;
+            // bytes transferred or -errno
+            std::int64_t result = 0;
+            // requests owned by the reactor thread, for cleanup on destruction
+            io_request* prev = nullptr;
+            io_request* next = nullptr;
+
+        protected:
+            io_request(int fd, kind op, void* buffer, std::size_t length, std::int64_t offset, void* owner) noexcept
+                : fd(fd), op(op), buffer(buffer), length(length), offset(offset), owner(owner)
+            {}
+        };
+
+        template<typename F>
+        struct io_request_impl final : io_request
+        {
+            io_request_impl(int fd, kind op, void* buffer, std::size_t length, std::int64_t offset, void* owner, F&& k)
+                : io_request(fd, op, buffer, length, offset, owner), k(std::move(k))
+            {}
+
+            void complete() override {
+                std::unique_ptr<io_request_impl> _(this);
+                std::invoke(this->k, this->result);
+            }
+
+            F k;
+        };
+
+        // offset < 0 uses the file position, as for pipes, sockets and eventfd
+        inline std::int64_t perform_io(const io_request& r) noexcept {
+            ::ssize_t n = 0;
+            if (r.op == io_request::kind::read) {
+                n = r.offset < 0 ? ::read(r.fd, r.buffer, r.length) : ::pread(r.fd, r.buffer, r.length, r.offset);
+            } else {
+                n = r.offset < 0 ? ::write(r.fd, r.buffer, r.length) : ::pwrite(r.fd, r.buffer, r.length, r.offset);
+            }
+            return n < 0 ? -errno : n;
+        }
+
+        // Reactor thread only, except for wake.
+        class io_driver
+        {
+        public:
+            io_driver() = default;
+            io_driver(const io_driver&) = delete;
+            io_driver& operator=(const io_driver&) = delete;
+            virtual ~io_driver() = default;
+
+            // Returns false if the backend cannot take more requests right now.
+            virtual bool submit(io_request* r) = 0;
+            // Pushes queued submissions to the kernel, appends completed requests.
+            // Blocks until something completes or wake is called if wait is set.
+            virtual void run(bool wait, std::vector<io_request*>& completed) = 0;
+            // Any thread.
+            virtual void wake() noexcept = 0;
+        };
+
+        class uring_driver final : public io_driver
+        {
+        public:
+            explicit uring_driver(unsigned entries) {
+                ::io_uring_params params;
+                std::memset(&params, 0, sizeof(params));
+                this->ring_fd = static_cast<int>(::syscall(__NR_io_uring_setup, std::max(entries, 2u), &params));
+                if (this->ring_fd < 0) {
+                    throw std::system_error(errno, std::generic_category(), "io_uring_setup");
+                }
+                try {
+                    // IORING_OP_READ / IORING_OP_WRITE with offset -1 came together with this feature
+                    if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+                        throw std::system_error(std::make_error_code(std::errc::function_not_supported), "io_uring: IORING_OP_READ");
+                    }
+                    this->map_rings(params);
+                    this->wake_fd = ::eventfd(0, EFD_CLOEXEC);
+                    if (this->wake_fd < 0) {
+                        throw std::system_error(errno, std::generic_category(), "eventfd");
+                    }
+                } catch (...) {
+                    this->release();
+                    throw;
+                }
+                this->arm_wake();
+            }
+
+            ~uring_driver() override { this->release(); }
+
+            bool submit(io_request* r) override {
+                // one submission and one completion slot stay reserved for the wake read
+                if (this->unsubmitted + 1 >= this->sq_entries || this->inflight + 1 >= this->cq_entries) {
+                    return false;
+                }
+                this->push(r->op == io_request::kind::read ? IORING_OP_READ : IORING_OP_WRITE,
+                    r->fd, r->buffer, r->length, r->offset, reinterpret_cast<std::uintptr_t>(r));
+                return true;
+            }
+
+            void run(bool wait, std::vector<io_request*>& completed) override {
+                if (this->unsubmitted != 0 || (wait && !this->has_completions())) {
+                    const auto submitted = ::syscall(__NR_io_uring_enter, this->ring_fd, this->unsubmitted,
+                        wait ? 1u : 0u, wait ? IORING_ENTER_GETEVENTS : 0u, nullptr, 0);
+                    // EINTR, EAGAIN and EBUSY only mean try again next round
+                    if (submitted > 0) {
+                        this->unsubmitted -= static_cast<std::uint32_t>(submitted);
+                    }
+                }
+                this->reap(completed);
+            }
+
+            void wake() noexcept override {
+                const std::uint64_t one = 1;
+                [[maybe_unused]] const auto _ = ::write(this->wake_fd, &one, sizeof(one));
+            }
+
+        private:
+            constexpr static std::uint64_t wake_token = 0;
+
+            void map_rings(const ::io_uring_params& params) {
+                std::size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(std::uint32_t);
+                std::size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(::io_uring_cqe);
+                const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+                if (single_mmap) {
+                    sq_size = cq_size = std::max(sq_size, cq_size);
+                }
+                this->sq_ring = map(sq_size, IORING_OFF_SQ_RING);
+                this->sq_ring_size = sq_size;
+                if (single_mmap) {
+                    this->cq_ring = this->sq_ring;
+                } else {
+                    this->cq_ring = map(cq_size, IORING_OFF_CQ_RING);
+                    this->cq_ring_size = cq_size;
+                }
+                this->sqes_size = params.sq_entries * sizeof(::io_uring_sqe);
+                this->sqes = static_cast<::io_uring_sqe*>(map(this->sqes_size, IORING_OFF_SQES));
+
+                this->sq_head = ring_field(this->sq_ring, params.sq_off.head);
+                this->sq_tail = ring_field(this->sq_ring, params.sq_off.tail);
+                this->sq_mask = *ring_field(this->sq_ring, params.sq_off.ring_mask);
+                this->sq_array = ring_field(this->sq_ring, params.sq_off.array);
+                this->sq_entries = params.sq_entries;
+                this->cq_head = ring_field(this->cq_ring, params.cq_off.head);
+                this->cq_tail = ring_field(this->cq_ring, params.cq_off.tail);
+                this->cq_mask = *ring_field(this->cq_ring, params.cq_off.ring_mask);
+                this->cqes = reinterpret_cast<::io_uring_cqe*>(static_cast<std::byte*>(this->cq_ring) + params.cq_off.cqes);
+                this->cq_entries = params.cq_entries;
+            }
+
+            void* map(std::size_t size, std::uint64_t offset) const {
+                void* const p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->ring_fd, static_cast<::off_t>(offset));
+                if (p == MAP_FAILED) {
+                    throw std::system_error(errno, std::generic_category(), "mmap io_uring");
+                }
+                return p;
+            }
+
+            static std::uint32_t* ring_field(void* ring, std::uint32_t offset) noexcept {
+                return reinterpret_cast<std::uint32_t*>(static_cast<std::byte*>(ring) + offset);
+            }
+
+            void release() noexcept {
+                if (this->sqes) {
+                    ::munmap(this->sqes, this->sqes_size);
+                }
+                if (this->cq_ring && this->cq_ring != this->sq_ring) {
+                    ::munmap(this->cq_ring, this->cq_ring_size);
+                }
+                if (this->sq_ring) {
+                    ::munmap(this->sq_ring, this->sq_ring_size);
+                }
+                if (this->wake_fd >= 0) {
+                    ::close(this->wake_fd);
+                }
+                // closing the ring cancels whatever is still in flight
+                if (this->ring_fd >= 0) {
+                    ::close(this->ring_fd);
+                }
+                this->sqes = nullptr;
+                this->sq_ring = this->cq_ring = nullptr;
+                this->wake_fd = this->ring_fd = -1;
+            }
+
+            // the kernel only reads sq_tail and writes sq_head, the reverse holds for the completion ring
+            void push(std::uint8_t opcode, int fd, void* buffer, std::size_t length, std::int64_t offset, std::uint64_t user_data) noexcept {
+                const auto tail = *this->sq_tail;
+                const auto index = tail & this->sq_mask;
+                ::io_uring_sqe& sqe = this->sqes[index];
+                std::memset(&sqe, 0, sizeof(sqe));
+                sqe.opcode = opcode;
+                sqe.fd = fd;
+                sqe.addr = reinterpret_cast<std::uintptr_t>(buffer);
+                sqe.len = static_cast<std::uint32_t>(std::min<std::size_t>(length, UINT32_MAX));
+                sqe.off = offset < 0 ? ~0ull : static_cast<std::uint64_t>(offset);
+                sqe.user_data = user_data;
+                this->sq_array[index] = index;
+                std::atomic_ref(*this->sq_tail).store(tail + 1, std::memory_order_release);
+                ++this->unsubmitted;
+                ++this->inflight;
+            }
+
+            void arm_wake() noexcept {
+                this->push(IORING_OP_READ, this->wake_fd, &this->wake_buffer, sizeof(this->wake_buffer), -1, wake_token);
+            }
+
+            bool has_completions() const noexcept {
+                return std::atomic_ref(*this->cq_tail).load(std::memory_order_acquire) != *this->cq_head;
+            }
+
+            void reap(std::vector<io_request*>& completed) {
+                auto head = *this->cq_head;
+                const auto tail = std::atomic_ref(*this->cq_tail).load(std::memory_order_acquire);
+                bool rearm = false;
+                for (; head != tail; ++head) {
+                    const ::io_uring_cqe& cqe = this->cqes[head & this->cq_mask];
+                    --this->inflight;
+                    if (cqe.user_data == wake_token) {
+                        rearm = true;
+                        continue;
+                    }
+                    auto* const r = reinterpret_cast<io_request*>(static_cast<std::uintptr_t>(cqe.user_data));
+                    r->result = cqe.res;
+                    completed.push_back(r);
+                }
+                std::atomic_ref(*this->cq_head).store(head, std::memory_order_release);
+                if (rearm) {
+                    this->arm_wake();
+                }
+            }
+
+            int ring_fd = -1;
+            int wake_fd = -1;
+            std::uint64_t wake_buffer = 0;
+            void* sq_ring = nullptr;
+            void* cq_ring = nullptr;
+            std::size_t sq_ring_size = 0;
+            std::size_t cq_ring_size = 0;
+            ::io_uring_sqe* sqes = nullptr;
+            std::size_t sqes_size = 0;
+            std::uint32_t* sq_head = nullptr;
+            std::uint32_t* sq_tail = nullptr;
+            std::uint32_t* sq_array = nullptr;
+            std::uint32_t sq_mask = 0;
+            std::uint32_t sq_entries = 0;
+            std::uint32_t* cq_head = nullptr;
+            std::uint32_t* cq_tail = nullptr;
+            ::io_uring_cqe* cqes = nullptr;
+            std::uint32_t cq_mask = 0;
+            std::uint32_t cq_entries = 0;
+            std::uint32_t unsubmitted = 0;
+            std::uint32_t inflight = 0;
+        };
+
+        class epoll_driver final : public io_driver
+        {
+        public:
+            epoll_driver() {
+                this->epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+                if (this->epoll_fd < 0) {
+                    throw std::system_error(errno, std::generic_category(), "epoll_create1");
+                }
+                this->wake_fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+                if (this->wake_fd < 0) {
+                    const auto error = errno;
+                    ::close(this->epoll_fd);
+                    throw std::system_error(error, std::generic_category(), "eventfd");
+                }
+                ::epoll_event ev{};
+                ev.events = EPOLLIN;
+                ev.data.fd = this->wake_fd;
+                if (::epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, this->wake_fd, &ev) != 0) {
+                    const auto error = errno;
+                    ::close(this->wake_fd);
+                    ::close(this->epoll_fd);
+                    throw std::system_error(error, std::generic_category(), "epoll_ctl");
+                }
+            }
+
+            ~epoll_driver() override {
+                ::close(this->wake_fd);
+                ::close(this->epoll_fd);
+            }
+
+            bool submit(io_request* r) override {
+                auto& state = this->states[r->fd];
+                auto& pending = r->op == io_request::kind::read ? state.reads : state.writes;
+                pending.push_back(r);
+                if (const auto error = this->update(r->fd, state)) {
+                    pending.pop_back();
+                    if (state.reads.empty() && state.writes.empty()) {
+                        this->states.erase(r->fd);
+                    }
+                    // regular files are always ready and cannot be polled
+                    r->result = error == EPERM ? perform_io(*r) : -error;
+                    this->immediate.push_back(r);
+                }
+                return true;
+            }
+
+            void run(bool wait, std::vector<io_request*>& completed) override {
+                const bool has_immediate = !this->immediate.empty();
+                completed.insert(completed.end(), this->immediate.begin(), this->immediate.end());
+                this->immediate.clear();
+                constexpr static int max_events = 64;
+                ::epoll_event events[max_events];
+                const int n = ::epoll_wait(this->epoll_fd, events, max_events, wait && !has_immediate ? -1 : 0);
+                for (int i = 0; i < n; ++i) {
+                    const int fd = events[i].data.fd;
+                    if (fd == this->wake_fd) {
+                        std::uint64_t value;
+                        [[maybe_unused]] const auto _ = ::read(this->wake_fd, &value, sizeof(value));
+                        continue;
+                    }
+                    const auto it = this->states.find(fd);
+                    if (it == this->states.end()) {
+                        continue;
+                    }
+                    // one operation per direction and event, level triggering brings the fd back
+                    const auto ready = events[i].events;
+                    if (ready & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                        perform_front(it->second.reads, completed);
+                    }
+                    if (ready & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+                        perform_front(it->second.writes, completed);
+                    }
+                    this->update(fd, it->second);
+                }
+            }
+
+            void wake() noexcept override {
+                const std::uint64_t one = 1;
+                [[maybe_unused]] const auto _ = ::write(this->wake_fd, &one, sizeof(one));
+            }
+
+        private:
+            struct fd_state
+            {
+                std::deque<io_request*> reads;
+                std::deque<io_request*> writes;
+                std::uint32_t events = 0;
+            };
+
+            static void perform_front(std::deque<io_request*>& pending, std::vector<io_request*>& completed) {
+                if (pending.empty()) {
+                    return;
+                }
+                io_request* const r = pending.front();
+                const auto result = perform_io(*r);
+                if (result == -EAGAIN || result == -EWOULDBLOCK) {
+                    return;
+                }
+                r->result = result;
+                pending.pop_front();
+                completed.push_back(r);
+            }
+
+            // Returns errno of epoll_ctl, the state is erased once nothing is pending.
+            int update(int fd, fd_state& state) {
+                const std::uint32_t wanted = (state.reads.empty() ? 0u : std::uint32_t(EPOLLIN)) | (state.writes.empty() ? 0u : std::uint32_t(EPOLLOUT));
+                if (wanted == state.events) {
+                    return 0;
+                }
+                ::epoll_event ev{};
+                ev.events = wanted;
+                ev.data.fd = fd;
+                const int op = wanted == 0 ? EPOLL_CTL_DEL : state.events == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+                if (::epoll_ctl(this->epoll_fd, op, fd, &ev) != 0 && op != EPOLL_CTL_DEL) {
+                    return errno;
+                }
+                state.events = wanted;
+                if (wanted == 0) {
+                    this->states.erase(fd);
+                }
+                return 0;
+            }
+
+            int epoll_fd = -1;
+            int wake_fd = -1;
+            std::unordered_map<int, fd_state> states;
+            std::vector<io_request*> immediate;
+        };
+
+    } // namespace details
+
+    template<typename T>
+        requires std::invocable<T&>
+    class io_reactor
+    {
+    public:
+        using value_type = T;
+        using worker_type = thread_worker<value_type>;
+        using pool_type = threadpool<value_type>;
+
+        io_reactor(const io_reactor&) = delete;
+        io_reactor& operator=(const io_reactor&) = delete;
+        io_reactor(io_reactor&&) = delete;
+        io_reactor& operator=(io_reactor&&) = delete;
+
+        // Owners are workers of pool, which must outlive the reactor.
+        // capacity bounds both pending submissions and operations in flight.
+        // Throws std::system_error if the requested backend is unavailable.
+        explicit io_reactor(pool_type& pool, std::size_t capacity = 1024, io_backend backend = io_backend::automatic)
+            : pool(&pool), inbox(capacity), driver(make_driver(capacity, backend))
+        {
+            this->thread = std::jthread([this] { this->reactor_loop(); });
+        }
+
+        // Operations still in flight are cancelled and their continuations never run,
+        // wait for every continuation before destroying the reactor.
+        ~io_reactor() {
+            this->stopping.store(true, std::memory_order_release);
+            this->driver.first->wake();
+            this->thread.join();
+            for (auto* r : this->inbox.wait_for_exclusive_values()) {
+                delete r;
+            }
+            this->driver.first.reset();
+            while (this->live) {
+                delete std::exchange(this->live, this->live->next);
+            }
+        }
+
+        io_backend backend() const noexcept { return this->driver.second; }
+
+        // Any thread, buffer must stay alive until k runs.
+        // k(result) runs as a value on owner, result is the number of bytes transferred or -errno.
+        // offset -1 reads at the file position, as pipes, sockets and eventfd need.
+        // Returns false if the reactor is saturated, k is dropped then.
+        template<typename F>
+            requires std::invocable<std::decay_t<F>&, std::int64_t>
+        bool read(worker_type& owner, int fd, void* buffer, std::size_t length, std::int64_t offset, F&& k) {
+            return this->submit(owner, fd, details::io_request::kind::read, buffer, length, offset, std::forward<F>(k));
+        }
+
+        template<typename F>
+            requires std::invocable<std::decay_t<F>&, std::int64_t>
+        bool write(worker_type& owner, int fd, const void* buffer, std::size_t length, std::int64_t offset, F&& k) {
+            return this->submit(owner, fd, details::io_request::kind::write, const_cast<void*>(buffer), length, offset, std::forward<F>(k));
+        }
+
+    private:
+        struct completion
+        {
+            void operator()() const { this->request->complete(); }
+            details::io_request* request;
+        };
+
+        static std::pair<std::unique_ptr<details::io_driver>, io_backend> make_driver(std::size_t capacity, io_backend backend) {
+            if (backend != io_backend::epoll) {
+                try {
+                    const auto entries = static_cast<unsigned>(std::clamp(capacity, 2uz, 4096uz));
+                    return { std::make_unique<details::uring_driver>(entries), io_backend::io_uring };
+                } catch (const std::system_error&) {
+                    // seccomp, io_uring_disabled or an old kernel
+                    if (backend == io_backend::io_uring) {
+                        throw;
+                    }
+                }
+            }
+            return { std::make_unique<details::epoll_driver>(), io_backend::epoll };
+        }
+
+        template<typename F>
+        bool submit(worker_type& owner, int fd, details::io_request::kind op, void* buffer, std::size_t length, std::int64_t offset, F&& k) {
+            using request_type = details::io_request_impl<std::decay_t<F>>;
+            auto* const r = new request_type(fd, op, buffer, length, offset, &owner, std::decay_t<F>(std::forward<F>(k)));
+            if (!this->inbox.enqueue(r)) {
+                delete r;
+                return false;
+            }
+            // pairs with the fence in reactor_loop
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (this->sleeping.load(std::memory_order_relaxed) && this->sleeping.exchange(false, std::memory_order_relaxed)) {
+                this->driver.first->wake();
+            }
+            return true;
+        }
+
+        void link(details::io_request* r) noexcept {
+            r->prev = nullptr;
+            r->next = this->live;
+            if (this->live) {
+                this->live->prev = r;
+            }
+            this->live = r;
+        }
+
+        void unlink(details::io_request* r) noexcept {
+            (r->prev ? r->prev->next : this->live) = r->next;
+            if (r->next) {
+                r->next->prev = r->prev;
+            }
+        }
+
+        void reactor_loop() {
+            auto& drv = *this->driver.first;
+            std::vector<details::io_request*> backlog;
+            std::vector<details::io_request*> completed;
+            while (!this->stopping.load(std::memory_order_acquire)) {
+                for (auto* r : this->inbox.wait_for_exclusive_values()) {
+                    this->link(r);
+                    backlog.push_back(r);
+                }
+                const auto accepted = std::ranges::find_if_not(backlog, [&drv](details::io_request* r) { return drv.submit(r); });
+                backlog.erase(backlog.begin(), accepted);
+
+                bool wait = this->undelivered.empty();
+                if (wait) {
+                    this->sleeping.store(true, std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    if (!this->inbox.empty() || this->stopping.load(std::memory_order_relaxed)) {
+                        this->sleeping.store(false, std::memory_order_relaxed);
+                        wait = false;
+                    }
+                }
+                drv.run(wait, completed);
+                this->sleeping.store(false, std::memory_order_relaxed);
+                this->undelivered.insert(this->undelivered.end(), completed.begin(), completed.end());
+                completed.clear();
+                if (!this->deliver()) {
+                    // some owner queue is full, retry without blocking the workers
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        // One submit_bulk_to per owner, completion order is kept per owner.
+        // Returns false if some continuation is left for the next round.
+        bool deliver() {
+            auto& pending = this->undelivered;
+            std::ranges::stable_sort(pending, {}, &details::io_request::owner);
+            std::size_t kept = 0;
+            for (std::size_t first = 0; first < pending.size();) {
+                auto* const owner = pending[first]->owner;
+                std::size_t last = first + 1;
+                while (last < pending.size() && pending[last]->owner == owner) {
+                    ++last;
+                }
+                // the owner may run and free them as soon as they are published
+                for (auto i = first; i < last; ++i) {
+                    this->unlink(pending[i]);
+                }
+                const auto accepted = this->pool->submit_bulk_to(*static_cast<worker_type*>(owner), last - first,
+                    [&pending, first](std::size_t i) noexcept -> value_type { return value_type(completion{ pending[first + i] }); });
+                for (auto i = first + accepted; i < last; ++i) {
+                    this->link(pending[i]);
+                    pending[kept++] = pending[i];
+                }
+                first = last;
+            }
+            pending.resize(kept);
+            return kept == 0;
+        }
+
+        pool_type* pool;
+        concurrent_queue<details::io_request*> inbox;
+        std::pair<std::unique_ptr<details::io_driver>, io_backend> driver;
+        // reactor thread only
+        std::vector<details::io_request*> undelivered;
+        details::io_request* live = nullptr;
+        alignas(std::hardware_destructive_interference_size) std::atomic_bool sleeping = false;
+        std::atomic_bool stopping = false;
+        std::jthread thread;
+    };
+
+} // namespace mylib
+
+#endif // __linux__
+
+#endif // MYLIB_IO_REACTOR_H
@@ -0,0 +1,315 @@
+#ifndef MYLIB_SCHEDULER_H
+#define MYLIB_SCHEDULER_H 1
+
+/*
+    * Header file for sender/receiver (P2300) scheduler over threadpool
+    *
+    * schedule() returns a sender that completes on a pool worker.
+    * schedule_bulk(shape, f) returns a sender that runs f(i) for every i in [0, shape) on the pool,
+    * split into chunks which are published with threadpool::submit_bulk.
+    * Operation states are immovable and are what the queued values point to,
+    * so nothing is allocated per operation as long as value_type stores a pointer-sized callable inline
+    * (std::move_only_function does).
+    *
+    * start() called from a job on one of the pool's workers never waits for room in the queues,
+    * since that worker may be the one that has to drain them: the values go to its local deque,
+    * or run right there when that is full too.
+    *
+    * Customization uses the C++26 member protocol (connect / start / set_value / get_env / query),
+    * tags come from std::execution when the standard library ships it.
+*/
+
+#include <concepts>
+#include <cstddef>
+
+#include <version>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#if defined(__cpp_lib_senders)
+#include <execution>
+#endif
+
+#include "threadpool.hpp"
+
+namespace mylib {
+
+    namespace execution {
+
+#if defined(__cpp_lib_senders)
+        using std::execution::sender_t;
+        using std::execution::operation_state_t;
+        using std::execution::scheduler_t;
+        using std::execution::set_value_t;
+        using std::execution::set_error_t;
+        using std::execution::set_stopped_t;
+        using std::execution::completion_signatures;
+        using std::execution::get_completion_scheduler_t;
+        using std::execution::get_completion_scheduler;
+#else
+        struct sender_t {};
+        struct operation_state_t {};
+        struct scheduler_t {};
+        struct set_value_t {};
+        struct set_error_t {};
+        struct set_stopped_t {};
+
+        template<typename... Sigs>
+        struct completion_signatures {};
+
+        template<typename CPO>
+        struct get_completion_scheduler_t {};
+
+        template<typename CPO>
+        inline constexpr get_completion_scheduler_t<CPO> get_completion_scheduler{};
+#endif
+
+    } // namespace execution
+
+    template<typename T>
+    class threadpool_scheduler
+    {
+    public:
+        using value_type = T;
+        using pool_type = threadpool<value_type>;
+        using scheduler_concept = execution::scheduler_t;
+
+    private:
+        struct env
+        {
+            threadpool_scheduler query(execution::get_completion_scheduler_t<execution::set_value_t>) const noexcept {
+                return threadpool_scheduler(*this->pool);
+            }
+
+            pool_type* pool;
+        };
+
+        template<typename Op>
+        struct task
+        {
+            void operator()() const noexcept { this->op->execute(); }
+            Op* op;
+        };
+
+        template<typename Op>
+        struct chunk_task
+        {
+            void operator()() const noexcept { this->op->execute(this->chunk); }
+            Op* op;
+            std::size_t chunk;
+        };
+
+    public:
+        template<typename Receiver>
+        class schedule_operation
+        {
+        public:
+            using operation_state_concept = execution::operation_state_t;
+
+            schedule_operation(const schedule_operation&) = delete;
+            schedule_operation& operator=(const schedule_operation&) = delete;
+            schedule_operation(schedule_operation&&) = delete;
+            schedule_operation& operator=(schedule_operation&&) = delete;
+
+            void start() & noexcept {
+                if (auto* const self = this->pool->current_worker()) {
+                    if (!self->spawn(value_type(task<schedule_operation>{ this }))) {
+                        // already on a pool worker, completing here is as good
+                        this->execute();
+                    }
+                    return;
+                }
+                while (!this->pool->submit(value_type(task<schedule_operation>{ this }))) {
+                    std::this_thread::yield();
+                }
+            }
+
+        private:
+            friend threadpool_scheduler;
+            friend task<schedule_operation>;
+
+            schedule_operation(pool_type* pool, Receiver&& rcvr)
+                : pool(pool), rcvr(std::move(rcvr))
+            {}
+
+            void execute() noexcept { std::move(this->rcvr).set_value(); }
+
+            pool_type* pool;
+            Receiver rcvr;
+        };
+
+        class schedule_sender
+        {
+        public:
+            using sender_concept = execution::sender_t;
+            using completion_signatures = execution::completion_signatures<execution::set_value_t()>;
+
+            template<typename Self, typename... Env>
+            static consteval completion_signatures get_completion_signatures() noexcept { return {}; }
+
+            env get_env() const noexcept { return env{ this->pool }; }
+
+            template<typename Receiver>
+            schedule_operation<std::remove_cvref_t<Receiver>> connect(Receiver&& rcvr) const {
+                return schedule_operation<std::remove_cvref_t<Receiver>>(this->pool, std::forward<Receiver>(rcvr));
+            }
+
+        private:
+            friend threadpool_scheduler;
+            explicit schedule_sender(pool_type* pool) noexcept : pool(pool) {}
+
+            pool_type* pool;
+        };
+
+        template<typename Receiver, typename F>
+        class bulk_operation
+        {
+        public:
+            using operation_state_concept = execution::operation_state_t;
+
+            bulk_operation(const bulk_operation&) = delete;
+            bulk_operation& operator=(const bulk_operation&) = delete;
+            bulk_operation(bulk_operation&&) = delete;
+            bulk_operation& operator=(bulk_operation&&) = delete;
+
+            void start() & noexcept {
+                if (this->shape == 0) {
+                    std::move(this->rcvr).set_value();
+                    return;
+                }
+                // a few chunks per worker so that stealing can balance uneven f
+                this->chunks = std::min(this->shape, this->pool->active_workers() * chunks_per_worker);
+                this->remaining.store(this->chunks, std::memory_order_relaxed);
+                // this may complete and be destroyed as soon as the last chunk is out, only locals from here
+                auto* const pool = this->pool;
+                const auto chunks = this->chunks;
+                auto* const self = pool->current_worker();
+                std::size_t submitted = 0;
+                while (submitted < chunks) {
+                    const auto accepted = pool->submit_bulk(chunks - submitted,
+                        [this, submitted](std::size_t i) noexcept -> value_type {
+                            return value_type(chunk_task<bulk_operation>{ this, submitted + i });
+                        });
+                    submitted += accepted;
+                    if (submitted == chunks) {
+                        break;
+                    }
+                    if (self != nullptr) {
+                        // queues are full and this thread is one that drains them, keep the rest here
+                        for (; submitted < chunks; ++submitted) {
+                            if (!self->spawn(value_type(chunk_task<bulk_operation>{ this, submitted }))) {
+                                this->execute(submitted);
+                            }
+                        }
+                    } else if (accepted == 0) {
+                        std::this_thread::yield();
+                    }
+                }
+            }
+
+        private:
+            friend threadpool_scheduler;
+            friend chunk_task<bulk_operation>;
+
+            constexpr static std::size_t chunks_per_worker = 4;
+
+            bulk_operation(pool_type* pool, std::size_t shape, F&& f, Receiver&& rcvr)
+                : pool(pool), shape(shape), f(std::move(f)), rcvr(std::move(rcvr))
+            {}
+
+            void execute(std::size_t chunk) noexcept {
+                const auto first = chunk * this->shape / this->chunks;
+                const auto last = (chunk + 1) * this->shape / this->chunks;
+                try {
+                    for (auto i = first; i < last; ++i) {
+                        std::invoke(this->f, i);
+                    }
+                } catch (...) {
+                    if (!this->failed.test_and_set(std::memory_order_relaxed)) {
+                        this->error = std::current_exception();
+                    }
+                }
+                if (this->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+                    return;
+                }
+                if (this->error) {
+                    std::move(this->rcvr).set_error(std::move(this->error));
+                } else {
+                    std::move(this->rcvr).set_value();
+                }
+            }
+
+            pool_type* pool;
+            std::size_t shape;
+            std::size_t chunks = 0;
+            F f;
+            Receiver rcvr;
+            std::exception_ptr error;
+            std::atomic_flag failed = {};
+            std::atomic_size_t remaining = 0;
+        };
+
+        template<typename F>
+        class bulk_sender
+        {
+        public:
+            using sender_concept = execution::sender_t;
+            using completion_signatures = execution::completion_signatures<
+                execution::set_value_t(),
+                execution::set_error_t(std::exception_ptr)
+            >;
+
+            template<typename Self, typename... Env>
+            static consteval completion_signatures get_completion_signatures() noexcept { return {}; }
+
+            env get_env() const noexcept { return env{ this->pool }; }
+
+            template<typename Receiver>
+            bulk_operation<std::remove_cvref_t<Receiver>, F> connect(Receiver&& rcvr) && {
+                return bulk_operation<std::remove_cvref_t<Receiver>, F>(this->pool, this->shape, std::move(this->f), std::forward<Receiver>(rcvr));
+            }
+
+            template<typename Receiver>
+                requires std::copy_constructible<F>
+            bulk_operation<std::remove_cvref_t<Receiver>, F> connect(Receiver&& rcvr) const& {
+                return bulk_operation<std::remove_cvref_t<Receiver>, F>(this->pool, this->shape, F(this->f), std::forward<Receiver>(rcvr));
+            }
+
+        private:
+            friend threadpool_scheduler;
+            bulk_sender(pool_type* pool, std::size_t shape, F&& f)
+                : pool(pool), shape(shape), f(std::move(f))
+            {}
+
+            pool_type* pool;
+            std::size_t shape;
+            F f;
+        };
+
+        explicit threadpool_scheduler(pool_type& pool) noexcept : pool(&pool) {}
+
+        friend bool operator==(const threadpool_scheduler&, const threadpool_scheduler&) = default;
+
+        schedule_sender schedule() const noexcept { return schedule_sender(this->pool); }
+
+        template<typename F>
+            requires std::invocable<std::decay_t<F>&, std::size_t>
+        bulk_sender<std::decay_t<F>> schedule_bulk(std::size_t shape, F&& f) const {
+            return bulk_sender<std::decay_t<F>>(this->pool, shape, std::decay_t<F>(std::forward<F>(f)));
+        }
+
+    private:
+        pool_type* pool;
+    };
+
+    template<typename T>
+    threadpool_scheduler(threadpool<T>&) -> threadpool_scheduler<T>;
+
+} // namespace mylib
+
+#endif // MYLIB_SCHEDULER_H
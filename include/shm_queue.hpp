@@ -0,0 +1,685 @@
+#ifndef MYLIB_SHM_QUEUE_H
+#define MYLIB_SHM_QUEUE_H 1
+
+/*
+    * Header file for cross-process shared memory queue implementation (Linux only)
+    *
+    * Same scheme as concurrent_queue, multiple producer PROCESSES and ONE consumer process,
+    * living in a memfd / shm_open segment. Everything inside the segment is addressed by offsets,
+    * so every process may map it anywhere. Values are trivially copyable messages,
+    * producers write them in place and the consumer reads batches without copying.
+    *
+    * Robustness: every producer owns a slot (pid, process start time, generation it holds a token of) in the segment.
+    * Each cell carries the generation stamp of the epoch it was published in,
+    * so instead of waiting on a leaving counter the consumer waits for stamps,
+    * and gives up on a cell once no live producer may still publish into the closed generation.
+    * Producers busy with later generations do not hold the consumer up.
+    * A producer that dies mid-publish thus costs its own message only.
+    *
+    * Generations are 32 bits and only advance on non-empty drains. On wrap-around they skip 0 and 1
+    * (0 means "never written" / "not publishing", and the buffer slot must keep alternating),
+    * and every buffer has its stamps cleared before its first use in the new cycle.
+*/
+
+#ifdef __linux__
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <iterator>
+#include <new>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "concurrent_queue.hpp"
+
+namespace mylib {
+
+    namespace details {
+
+        inline constexpr std::uint64_t shm_magic = 0x716d735f62696c6d; // "mlib_smq"
+        inline constexpr std::uint64_t shm_count_mask = 0xffff'ffffull;
+        inline constexpr std::size_t shm_generation_shift = 32;
+        inline constexpr std::uint64_t shm_last_generation = 0xffff'ffffull;
+
+        inline constexpr std::uint64_t shm_next_generation(std::uint64_t generation) noexcept {
+            // 2 keeps the parity alternating after the odd last generation
+            return generation == shm_last_generation ? 2 : generation + 1;
+        }
+
+        // Whether generation a was opened after b, valid across one wrap-around.
+        inline constexpr bool shm_generation_after(std::uint64_t a, std::uint64_t b) noexcept {
+            return static_cast<std::int32_t>(static_cast<std::uint32_t>(a - b)) > 0;
+        }
+
+        static_assert(std::atomic_uint64_t::is_always_lock_free && std::atomic_uint32_t::is_always_lock_free,
+            "Atomics shared between processes must be lock free");
+
+        struct alignas(queue_align) shm_header
+        {
+            std::uint64_t magic;
+            std::uint64_t capacity;
+            std::uint64_t message_size;
+            std::uint64_t cell_size;
+            std::uint64_t max_producers;
+            std::uint64_t producers_offset;
+            std::uint64_t segment_size;
+            // (generation << 32) | tokens taken in this generation
+            alignas(queue_align) std::atomic_uint64_t entering_counter;
+            std::atomic_uint32_t full_flag;
+            // producers of generation g write into buffer slot_offsets[g & 1]
+            alignas(queue_align) std::atomic_uint64_t slot_offsets[2];
+            std::uint64_t spare_offset; // consumer only, 0 while the batch holds it
+            std::uint64_t stale_offset; // consumer only, buffer still stamped with the previous cycle, 0 if none
+            alignas(queue_align) std::atomic_uint32_t idle_epoch;
+            std::atomic_uint32_t parked;
+        };
+
+        struct alignas(queue_align) shm_producer_slot
+        {
+            std::atomic<::pid_t> pid;
+            // start time of the process, tells it apart from a later one reusing the pid, 0 if unknown
+            std::atomic_uint64_t start_time;
+            // generation the producer takes (or holds) a token of, 0 while not publishing
+            std::atomic_uint64_t generation;
+        };
+
+        template<typename T>
+        struct alignas(queue_align) shm_cell
+        {
+            // generation of the last message committed here
+            std::atomic_uint64_t stamp;
+            T value;
+        };
+
+        [[noreturn]] inline void throw_errno(const char* what) {
+            throw std::system_error(errno, std::generic_category(), what);
+        }
+
+        // Process-shared futex, std::atomic::wait only works within one process.
+        inline void shm_futex_wait(std::atomic_uint32_t& word, std::uint32_t expected) noexcept {
+            ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT, expected, nullptr, nullptr, 0);
+        }
+
+        inline void shm_futex_wake(std::atomic_uint32_t& word) noexcept {
+            ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+        }
+
+        struct process_stat
+        {
+            bool exists = true;
+            char state = '?';
+            // clock ticks after boot, 0 if unknown
+            std::uint64_t start_time = 0;
+        };
+
+        // Fields 3 (state) and 22 (starttime) of /proc/<pid>/stat, whatever cannot be read stays unknown.
+        inline process_stat read_process_stat(::pid_t pid) noexcept {
+            process_stat result;
+            char path[32];
+            std::snprintf(path, sizeof(path), "/proc/%d/stat", static_cast<int>(pid));
+            const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                result.exists = errno != ENOENT;
+                return result;
+            }
+            // "pid (comm) state ppid ...", comm is at most 16 bytes but may contain ')'
+            char stat[512];
+            const auto n = ::read(fd, stat, sizeof(stat) - 1);
+            ::close(fd);
+            if (n <= 0) {
+                return result;
+            }
+            stat[n] = '\0';
+            const char* const comm_end = std::strrchr(stat, ')');
+            if (comm_end == nullptr || comm_end[1] == '\0' || comm_end[2] == '\0') {
+                return result;
+            }
+            result.state = comm_end[2];
+            const char* field = comm_end + 2;
+            for (int i = 3; i < 22 && field != nullptr; ++i) {
+                field = std::strchr(field, ' ');
+                field = field ? field + 1 : nullptr;
+            }
+            if (field != nullptr) {
+                result.start_time = std::strtoull(field, nullptr, 10);
+            }
+            return result;
+        }
+
+        // Zombies count as dead, the consumer may well be the parent that has not reaped them yet.
+        // So does a process started at another time than start_time, it only reuses the pid.
+        inline bool process_alive(::pid_t pid, std::uint64_t start_time) noexcept {
+            if (::kill(pid, 0) != 0 && errno == ESRCH) {
+                return false;
+            }
+            const auto stat = read_process_stat(pid);
+            if (!stat.exists || stat.state == 'Z' || stat.state == 'X') {
+                return false;
+            }
+            return start_time == 0 || stat.start_time == 0 || stat.start_time == start_time;
+        }
+
+        // Owns one mapping of a segment and its file descriptor.
+        class shm_mapping
+        {
+        public:
+            shm_mapping() = default;
+            shm_mapping(const shm_mapping&) = delete;
+            shm_mapping& operator=(const shm_mapping&) = delete;
+
+            shm_mapping(shm_mapping&& other) noexcept
+                : fd(std::exchange(other.fd, -1)), base(std::exchange(other.base, nullptr)), size(std::exchange(other.size, 0))
+            {}
+
+            shm_mapping& operator=(shm_mapping&& other) noexcept {
+                if (this != &other) {
+                    this->reset();
+                    this->fd = std::exchange(other.fd, -1);
+                    this->base = std::exchange(other.base, nullptr);
+                    this->size = std::exchange(other.size, 0);
+                }
+                return *this;
+            }
+
+            ~shm_mapping() { this->reset(); }
+
+            // size 0 maps the whole file
+            static shm_mapping map(int fd, std::size_t size) {
+                shm_mapping result;
+                result.fd = fd;
+                if (size == 0) {
+                    struct ::stat st;
+                    if (::fstat(fd, &st) != 0) {
+                        throw_errno("fstat");
+                    }
+                    size = static_cast<std::size_t>(st.st_size);
+                } else if (::ftruncate(fd, static_cast<::off_t>(size)) != 0) {
+                    throw_errno("ftruncate");
+                }
+                void* const base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                if (base == MAP_FAILED) {
+                    throw_errno("mmap");
+                }
+                result.base = static_cast<std::byte*>(base);
+                result.size = size;
+                return result;
+            }
+
+            int native_handle() const noexcept { return this->fd; }
+            std::byte* data() const noexcept { return this->base; }
+            std::size_t bytes() const noexcept { return this->size; }
+
+            template<typename U>
+            U* at(std::uint64_t offset) const noexcept {
+                return std::launder(reinterpret_cast<U*>(this->base + offset));
+            }
+
+        private:
+            void reset() noexcept {
+                if (this->base) {
+                    ::munmap(this->base, this->size);
+                }
+                if (this->fd >= 0) {
+                    ::close(this->fd);
+                }
+                this->fd = -1;
+                this->base = nullptr;
+                this->size = 0;
+            }
+
+            int fd = -1;
+            std::byte* base = nullptr;
+            std::size_t size = 0;
+        };
+
+        inline int open_fd(const char* name, int flags) {
+            const int fd = name ? ::shm_open(name, flags, 0600) : ::memfd_create("mylib_shm_queue", MFD_CLOEXEC);
+            if (fd < 0) {
+                throw_errno(name ? "shm_open" : "memfd_create");
+            }
+            return fd;
+        }
+
+    } // namespace details
+
+    template<typename T>
+        requires std::is_trivially_copyable_v<T> && std::default_initializable<T>
+    class shm_consumer
+    {
+    public:
+        using value_type = T;
+        using cell_type = details::shm_cell<value_type>;
+
+        // Zero-copy view of one drained buffer, cells abandoned by dead producers are skipped.
+        class [[nodiscard("Contents of queue should be consumed.")]] batch
+        {
+        public:
+            class iterator
+            {
+            public:
+                using iterator_category = std::forward_iterator_tag;
+                using difference_type = std::ptrdiff_t;
+                using value_type = shm_consumer::value_type;
+                using reference = const value_type&;
+
+                iterator() = default;
+
+                friend bool operator==(const iterator&, const iterator&) = default;
+
+                const value_type& operator*() const noexcept { return this->cell->value; }
+                const value_type* operator->() const noexcept { return &this->cell->value; }
+
+                iterator& operator++() noexcept { ++this->cell; this->skip(); return *this; }
+                iterator operator++(int) noexcept { iterator cached = *this; ++*this; return cached; }
+
+            private:
+                friend batch;
+                iterator(const cell_type* cell, const cell_type* last, std::uint64_t generation) noexcept
+                    : cell(cell), last(last), generation(generation)
+                { this->skip(); }
+
+                void skip() noexcept {
+                    while (this->cell != this->last && this->cell->stamp.load(std::memory_order_relaxed) != this->generation) {
+                        ++this->cell;
+                    }
+                }
+
+                const cell_type* cell = nullptr;
+                const cell_type* last = nullptr;
+                std::uint64_t generation = 0;
+            };
+
+            batch() = default;
+            batch(const batch&) = delete;
+            batch& operator=(const batch&) = delete;
+
+            batch(batch&& other) noexcept
+                : owner(std::exchange(other.owner, nullptr)), offset(other.offset)
+                , count(other.count), committed(other.committed), generation(other.generation)
+            {}
+
+            batch& operator=(batch&& other) noexcept {
+                if (this != &other) {
+                    this->release();
+                    this->owner = std::exchange(other.owner, nullptr);
+                    this->offset = other.offset;
+                    this->count = other.count;
+                    this->committed = other.committed;
+                    this->generation = other.generation;
+                }
+                return *this;
+            }
+
+            ~batch() { this->release(); }
+
+            iterator begin() const noexcept { return iterator(this->cells(), this->cells() + this->count, this->generation); }
+            iterator end() const noexcept { return iterator(this->cells() + this->count, this->cells() + this->count, this->generation); }
+
+            // number of messages, abandoned cells excluded
+            std::size_t size() const noexcept { return this->committed; }
+            bool empty() const noexcept { return this->committed == 0; }
+            // number of cells given up because their producer died
+            std::size_t abandoned() const noexcept { return this->count - this->committed; }
+
+            void release() noexcept {
+                if (this->owner) {
+                    this->owner->header()->spare_offset = this->offset;
+                    this->owner = nullptr;
+                }
+            }
+
+        private:
+            friend shm_consumer;
+            batch(shm_consumer* owner, std::uint64_t offset, std::size_t count, std::size_t committed, std::uint64_t generation) noexcept
+                : owner(owner), offset(offset), count(count), committed(committed), generation(generation)
+            {}
+
+            const cell_type* cells() const noexcept {
+                return this->owner ? this->owner->mapping.template at<cell_type>(this->offset) : nullptr;
+            }
+
+            shm_consumer* owner = nullptr;
+            std::uint64_t offset = 0;
+            std::size_t count = 0;
+            std::size_t committed = 0;
+            std::uint64_t generation = 0;
+        };
+
+        static_assert(std::forward_iterator<typename batch::iterator>);
+
+        shm_consumer(const shm_consumer&) = delete;
+        shm_consumer& operator=(const shm_consumer&) = delete;
+        shm_consumer(shm_consumer&&) = delete;
+        shm_consumer& operator=(shm_consumer&&) = delete;
+
+        // Anonymous segment (memfd), hand native_handle() to producers (fork, SCM_RIGHTS, /proc/<pid>/fd).
+        shm_consumer(std::size_t capacity, std::size_t max_producers)
+            : shm_consumer(details::open_fd(nullptr, 0), capacity, max_producers)
+        {}
+
+        // Named segment (shm_open), producers open it by name. The name is unlinked on destruction.
+        shm_consumer(const char* name, std::size_t capacity, std::size_t max_producers)
+            : shm_consumer(details::open_fd(name, O_CREAT | O_EXCL | O_RDWR), capacity, max_producers)
+        {
+            this->name = name;
+        }
+
+        ~shm_consumer() {
+            if (!this->name.empty()) {
+                ::shm_unlink(this->name.c_str());
+            }
+        }
+
+        int native_handle() const noexcept { return this->mapping.native_handle(); }
+        std::size_t capacity() const noexcept { return this->header()->capacity; }
+
+        // Returns an empty batch while the previous batch is still held.
+        batch wait_for_exclusive_values() noexcept {
+            auto* const head = this->header();
+            if (head->spare_offset == 0) {
+                return batch();
+            }
+            // only the consumer changes the generation, producers only add to the low half,
+            // so once a token is seen the generation can be closed, empty polls leave it alone
+            auto observed = head->entering_counter.load(std::memory_order_relaxed);
+            if ((observed & details::shm_count_mask) == 0) {
+                return batch();
+            }
+            const auto generation = observed >> details::shm_generation_shift;
+            const auto next = details::shm_next_generation(generation);
+            if (next < generation) {
+                // nobody writes into the next slot or the spare before the new generation opens
+                this->clear_stamps(head->slot_offsets[next & 1].load(std::memory_order_relaxed));
+                this->clear_stamps(head->spare_offset);
+                head->stale_offset = head->slot_offsets[generation & 1].load(std::memory_order_relaxed);
+            }
+            while (!head->entering_counter.compare_exchange_weak(observed, next << details::shm_generation_shift,
+                std::memory_order_seq_cst, std::memory_order_relaxed)) {}
+            head->full_flag.store(0, std::memory_order_relaxed);
+            const auto count = std::min(observed & details::shm_count_mask, head->capacity);
+
+            auto& slot = head->slot_offsets[generation & 1];
+            const auto offset = slot.load(std::memory_order_relaxed);
+            cell_type* const cells = this->mapping.template at<cell_type>(offset);
+            std::size_t committed = 0;
+            for (std::size_t i = 0; i < count; ++i) {
+                committed += this->wait_for_cell(cells[i], generation);
+            }
+            // producers of generation + 2 will see the spare through entering_counter
+            const auto spare = std::exchange(head->spare_offset, 0);
+            if (spare == head->stale_offset) {
+                this->clear_stamps(spare);
+                head->stale_offset = 0;
+            }
+            slot.store(spare, std::memory_order_relaxed);
+            return batch(this, offset, count, committed, generation);
+        }
+
+        // Same idle protocol as concurrent_queue, on a process-shared futex.
+        using park_ticket = std::uint32_t;
+
+        bool empty() const noexcept {
+            return (this->header()->entering_counter.load(std::memory_order_relaxed) & details::shm_count_mask) == 0;
+        }
+
+        park_ticket prepare_park() noexcept {
+            auto* const head = this->header();
+            const auto ticket = head->idle_epoch.load(std::memory_order_acquire);
+            head->parked.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            return ticket;
+        }
+
+        void cancel_park() noexcept {
+            this->header()->parked.store(0, std::memory_order_relaxed);
+        }
+
+        void park(park_ticket ticket) noexcept {
+            auto* const head = this->header();
+            while (this->empty() && head->idle_epoch.load(std::memory_order_acquire) == ticket) {
+                details::shm_futex_wait(head->idle_epoch, ticket);
+            }
+            head->parked.store(0, std::memory_order_relaxed);
+        }
+
+    private:
+        shm_consumer(int fd, std::size_t capacity, std::size_t max_producers) {
+            using namespace details;
+            capacity = std::clamp(capacity, 1uz, static_cast<std::size_t>(shm_count_mask >> 1));
+            max_producers = std::max(max_producers, 1uz);
+            const std::uint64_t producers_offset = sizeof(shm_header);
+            const std::uint64_t buffers_offset = (producers_offset + sizeof(shm_producer_slot) * max_producers + alignof(cell_type) - 1)
+                / alignof(cell_type) * alignof(cell_type);
+            const std::uint64_t buffer_size = sizeof(cell_type) * capacity;
+            const std::uint64_t segment_size = buffers_offset + buffer_size * 3;
+            try {
+                this->mapping = shm_mapping::map(fd, segment_size);
+            } catch (...) {
+                ::close(fd);
+                throw;
+            }
+
+            std::byte* const base = this->mapping.data();
+            for (std::size_t i = 0; i < max_producers; ++i) {
+                new(base + producers_offset + sizeof(shm_producer_slot) * i) shm_producer_slot{};
+            }
+            for (std::size_t i = 0; i < capacity * 3; ++i) {
+                new(base + buffers_offset + sizeof(cell_type) * i) cell_type{};
+            }
+            auto* const head = new(base) shm_header{};
+            head->capacity = capacity;
+            head->message_size = sizeof(value_type);
+            head->cell_size = sizeof(cell_type);
+            head->max_producers = max_producers;
+            head->producers_offset = producers_offset;
+            head->segment_size = segment_size;
+            // generation 0 is what fresh cells are stamped with, start at 1
+            head->entering_counter.store(1ull << shm_generation_shift, std::memory_order_relaxed);
+            head->slot_offsets[0].store(buffers_offset, std::memory_order_relaxed);
+            head->slot_offsets[1].store(buffers_offset + buffer_size, std::memory_order_relaxed);
+            head->spare_offset = buffers_offset + buffer_size * 2;
+            // producers check the magic last
+            std::atomic_thread_fence(std::memory_order_release);
+            std::atomic_ref(head->magic).store(shm_magic, std::memory_order_release);
+        }
+
+        details::shm_header* header() const noexcept { return this->mapping.template at<details::shm_header>(0); }
+
+        void clear_stamps(std::uint64_t offset) noexcept {
+            cell_type* const cells = this->mapping.template at<cell_type>(offset);
+            for (std::size_t i = 0; i < this->header()->capacity; ++i) {
+                cells[i].stamp.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        // Returns whether the cell was committed, false if it was abandoned.
+        bool wait_for_cell(const cell_type& cell, std::uint64_t generation) noexcept {
+            constexpr std::size_t spins_between_checks = 1024;
+            for (std::size_t spins = 1; cell.stamp.load(std::memory_order_acquire) != generation; ++spins) {
+                if (spins % spins_between_checks == 0 && !this->any_producer_holding(generation)) {
+                    // a producer leaves the generation only after committing, so look once more
+                    return cell.stamp.load(std::memory_order_acquire) == generation;
+                }
+                std::this_thread::yield();
+            }
+            return true;
+        }
+
+        // Any live producer that may still hold a token of the closed generation.
+        // A slot announces a generation no later than the one of its token (see shm_producer::publish),
+        // so slots that are idle or already past closed are skipped without looking at the process.
+        bool any_producer_holding(std::uint64_t closed) noexcept {
+            auto* const head = this->header();
+            auto* const slots = this->mapping.template at<details::shm_producer_slot>(head->producers_offset);
+            bool result = false;
+            for (std::size_t i = 0; i < head->max_producers; ++i) {
+                auto& slot = slots[i];
+                const auto generation = slot.generation.load(std::memory_order_seq_cst);
+                if (generation == 0 || details::shm_generation_after(generation, closed)) {
+                    continue;
+                }
+                auto pid = slot.pid.load(std::memory_order_relaxed);
+                if (pid == 0) {
+                    continue;
+                }
+                // acquire on generation above: the start time stored when the slot was taken
+                if (details::process_alive(pid, slot.start_time.load(std::memory_order_relaxed))) {
+                    result = true;
+                } else {
+                    // reclaim the slot of the dead producer
+                    slot.generation.store(0, std::memory_order_relaxed);
+                    slot.pid.compare_exchange_strong(pid, 0, std::memory_order_release, std::memory_order_relaxed);
+                }
+            }
+            return result;
+        }
+
+        details::shm_mapping mapping;
+        std::string name;
+    };
+
+    // One per producing thread, each takes a slot of the segment.
+    template<typename T>
+        requires std::is_trivially_copyable_v<T> && std::default_initializable<T>
+    class shm_producer
+    {
+    public:
+        using value_type = T;
+        using cell_type = details::shm_cell<value_type>;
+
+        shm_producer(const shm_producer&) = delete;
+        shm_producer& operator=(const shm_producer&) = delete;
+        shm_producer(shm_producer&&) = delete;
+        shm_producer& operator=(shm_producer&&) = delete;
+
+        // Maps the segment behind fd, fd is duplicated.
+        explicit shm_producer(int fd) : shm_producer(duplicate(fd), 0) {}
+
+        // Opens a segment created by shm_consumer(name, ...).
+        explicit shm_producer(const char* name) : shm_producer(details::open_fd(name, O_RDWR), 0) {}
+
+        ~shm_producer() {
+            this->slot->generation.store(0, std::memory_order_relaxed);
+            this->slot->pid.store(0, std::memory_order_release);
+        }
+
+        // Writes a message in place, write(T&) must not throw.
+        // A producer killed inside write loses this message only.
+        template<typename F>
+            requires std::is_nothrow_invocable_v<F&, value_type&>
+        bool publish(F&& write) noexcept {
+            auto* const head = this->header();
+            if (head->full_flag.load(std::memory_order_relaxed)) {
+                return false;
+            }
+            // announce the current generation before taking a token, the token can only be of that one or later,
+            // and the consumer closing a generation only waits for slots announcing it or an earlier one
+            const auto announced = head->entering_counter.load(std::memory_order_seq_cst) >> details::shm_generation_shift;
+            this->slot->generation.store(announced, std::memory_order_seq_cst);
+            details::defer _([this] { this->slot->generation.store(0, std::memory_order_seq_cst); });
+
+            const auto queue_token = head->entering_counter.fetch_add(1, std::memory_order_seq_cst);
+            const auto generation = queue_token >> details::shm_generation_shift;
+            if (generation != announced) {
+                this->slot->generation.store(generation, std::memory_order_seq_cst);
+            }
+            const auto queue_number = queue_token & details::shm_count_mask;
+            bool result = false;
+            if (queue_number < head->capacity) {
+                const auto offset = head->slot_offsets[generation & 1].load(std::memory_order_relaxed);
+                cell_type& cell = this->mapping.template at<cell_type>(offset)[queue_number];
+                write(cell.value);
+                cell.stamp.store(generation, std::memory_order_release);
+                result = true;
+            } else {
+                head->full_flag.store(1, std::memory_order_relaxed);
+            }
+            if (queue_number == 0) {
+                this->notify_parked();
+            }
+            return result;
+        }
+
+        bool enqueue(const value_type& v) noexcept {
+            return this->publish([&v](value_type& cell) noexcept { std::memcpy(&cell, &v, sizeof(value_type)); });
+        }
+
+    private:
+        static int duplicate(int fd) {
+            const int result = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+            if (result < 0) {
+                details::throw_errno("fcntl");
+            }
+            return result;
+        }
+
+        shm_producer(int fd, int) {
+            using namespace details;
+            try {
+                this->mapping = shm_mapping::map(fd, 0);
+            } catch (...) {
+                ::close(fd);
+                throw;
+            }
+            if (this->mapping.bytes() < sizeof(shm_header)) {
+                throw std::system_error(std::make_error_code(std::errc::invalid_argument), "shm_producer: segment too small");
+            }
+            auto* const head = this->header();
+            if (std::atomic_ref(head->magic).load(std::memory_order_acquire) != shm_magic
+                || head->message_size != sizeof(value_type) || head->cell_size != sizeof(cell_type)
+                || head->segment_size > this->mapping.bytes()) {
+                throw std::system_error(std::make_error_code(std::errc::invalid_argument), "shm_producer: incompatible segment");
+            }
+            auto* const slots = this->mapping.template at<shm_producer_slot>(head->producers_offset);
+            const ::pid_t self = ::getpid();
+            for (std::size_t i = 0; i < head->max_producers; ++i) {
+                ::pid_t expected = 0;
+                if (slots[i].pid.compare_exchange_strong(expected, self, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                    // only looked at while the slot announces a generation, which is stored later
+                    slots[i].start_time.store(read_process_stat(self).start_time, std::memory_order_relaxed);
+                    this->slot = &slots[i];
+                    return;
+                }
+            }
+            throw std::system_error(std::make_error_code(std::errc::resource_unavailable_try_again), "shm_producer: no free producer slot");
+        }
+
+        details::shm_header* header() const noexcept { return this->mapping.template at<details::shm_header>(0); }
+
+        void notify_parked() noexcept {
+            auto* const head = this->header();
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (head->parked.load(std::memory_order_relaxed) && head->parked.exchange(0, std::memory_order_relaxed)) {
+                head->idle_epoch.fetch_add(1, std::memory_order_release);
+                details::shm_futex_wake(head->idle_epoch);
+            }
+        }
+
+        details::shm_mapping mapping;
+        details::shm_producer_slot* slot = nullptr;
+    };
+
+} // namespace mylib
+
+#endif // __linux__
+
+#endif // MYLIB_SHM_QUEUE_H
@@ -1,18 +1,153 @@
 #ifndef MYLIB_THREAD_WORKER_H
 #define MYLIB_THREAD_WORKER_H 1
 
+/*
+    * Header file for thread worker implementation
+    *
+    * A worker pairs the shared MPSC concurrent_queue (external submissions)
+    * with an owner-local work_stealing_deque (values spawned by jobs running on the worker).
+    * The owning thread always drains its local deque before asking the shared queue for a new batch.
+*/
+
 #include <concepts>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <utility>
 #include <atomic>
+#include <chrono>
 #include <thread>
 
 #include "concurrent_queue.hpp"
+#include "work_stealing_deque.hpp"
+#include "trace.hpp"
 
 namespace mylib {
 
-    // TODO
+    template<typename T>
+        requires std::invocable<T&>
+    class thread_worker
+    {
+    public:
+        using value_type = T;
+        using queue_type = concurrent_queue<value_type>;
+        using local_queue_type = work_stealing_deque<value_type>;
+
+        thread_worker() = delete;
+        thread_worker(const thread_worker&) = delete;
+        thread_worker& operator=(const thread_worker&) = delete;
+        thread_worker(thread_worker&&) = delete;
+        thread_worker& operator=(thread_worker&&) = delete;
+
+        thread_worker(std::size_t queue_capacity, std::size_t local_capacity)
+            : queue(queue_capacity), local_queue(local_capacity)
+        {
+            // every value of the shared queue ends in execute
+            this->queue.trace_flows();
+        }
+
+        // Worker whose job is running on the calling thread, if any.
+        static thread_worker* current() noexcept { return current_worker; }
+
+        // Any thread.
+        bool enqueue(value_type&& v) noexcept { return this->queue.enqueue(std::move(v)); }
+
+        // Any thread.
+        template<typename F>
+        std::size_t enqueue_bulk(std::size_t count, F&& make) noexcept { return this->queue.enqueue_bulk(count, std::forward<F>(make)); }
+
+        // Called from a job running on this worker, v stays hot on the local deque.
+        // Falls back to the shared queue when called elsewhere or when the local deque is full.
+        bool spawn(value_type&& v) noexcept {
+            if (current_worker == this && this->local_queue.push(std::move(v))) {
+                return true;
+            }
+            return this->queue.enqueue(std::move(v));
+        }
+
+        // Owner only, see concurrent_queue::prepare_park.
+        // The local deque is always empty between run_once calls, so only the shared queue is watched.
+        typename queue_type::park_ticket prepare_park() noexcept { return this->queue.prepare_park(); }
+        void cancel_park() noexcept { this->queue.cancel_park(); }
+        void park(typename queue_type::park_ticket ticket) noexcept { this->queue.park(ticket); }
+        template<typename Clock, typename Duration>
+        void park_until(typename queue_type::park_ticket ticket, const std::chrono::time_point<Clock, Duration>& deadline) noexcept {
+            this->queue.park_until(ticket, deadline);
+        }
+
+        // Any thread.
+        void wake() noexcept { this->queue.wake(); }
+
+        // Owner only.
+        // Executes local values first, then one batch from the shared queue.
+        // Returns the number of values executed.
+        std::size_t run_once() {
+            const auto _ = this->bind();
+            std::size_t executed = this->drain_local();
+            if (executed != 0) {
+                return executed;
+            }
+            const auto values = this->queue.wait_for_exclusive_values();
+            for (auto it = values.begin(); it != values.end(); ++it) {
+                execute(*it, &this->queue, it.flow());
+                executed += 1 + this->drain_local();
+            }
+            return executed;
+        }
+
+        // Owner only.
+        // Steals a whole batch from victim's shared queue, or a single value from its local deque.
+        // Returns the number of values executed.
+        std::size_t steal_from(thread_worker& victim) {
+            const auto _ = this->bind();
+            std::size_t executed = 0;
+            const auto values = this->queue.steal(victim.queue);
+            for (auto it = values.begin(); it != values.end(); ++it) {
+                execute(*it, &victim.queue, it.flow());
+                executed += 1 + this->drain_local();
+            }
+            if (executed != 0) {
+                return executed;
+            }
+            if (auto v = victim.local_queue.steal()) {
+                trace::instant(trace::event_kind::steal, &victim.local_queue, 1);
+                execute(*v, &victim.local_queue);
+                executed += 1 + this->drain_local();
+            }
+            return executed;
+        }
+
+    private:
+        struct binder {
+            ~binder() { current_worker = this->prev; }
+            thread_worker* prev;
+        };
+
+        [[nodiscard]] binder bind() noexcept {
+            return binder{ std::exchange(current_worker, this) };
+        }
+
+        std::size_t drain_local() {
+            std::size_t executed = 0;
+            while (auto v = this->local_queue.pop()) {
+                execute(*v, &this->local_queue);
+                ++executed;
+            }
+            return executed;
+        }
+
+        // Values from the local deque have no flow, they never wait behind other threads.
+        static void execute(value_type& v, const void* source, trace::flow flow = {}) {
+            trace::span _(trace::event_kind::execute, source, flow);
+            std::invoke(v);
+        }
+
+        static inline thread_local thread_worker* current_worker = nullptr;
+
+        queue_type queue;
+        local_queue_type local_queue;
+    };
 
 } // namespace mylib
 
@@ -1,9 +1,378 @@
 #ifndef MYLIB_THREADPOOL_H
 #define MYLIB_THREADPOOL_H 1
 
+/*
+    * Header file for thread pool implementation
+    *
+    * The pool owns up to max_workers thread_worker slots, each with its own concurrent_queue.
+    * Slots [0, active_workers) are running, producers spread values over them round robin.
+    * With min_workers < max_workers the pool is elastic:
+    * it grows on sustained pressure (full queues or big batches)
+    * and the last active worker retires once it has been mostly idle for idle_timeout.
+    * Without pressure producers leave that worker out, so under light traffic it only helps
+    * through steal, and retires unless stealing kept it busy for retire_utilisation of the window.
+    * Values that land in a retired slot are picked up by the survivors through steal.
+    * Growing never waits for a retired worker still running its last values, its slot is skipped until it has left.
+    * Other idle workers park on their own queue after idle_spins empty rounds,
+    * and are woken by the enqueue that makes the queue non-empty.
+    * The retirement candidate parks too, but only until its idle_timeout window closes.
+*/
+
+#include <concepts>
+#include <cstddef>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <new>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <type_traits>
+
+#include "thread_worker.hpp"
+
 namespace mylib {
 
+    struct threadpool_options
+    {
+        std::size_t queue_capacity = 1024;
+        std::size_t local_capacity = 256;
+        std::size_t min_workers = std::max(std::thread::hardware_concurrency(), 1u);
+        std::size_t max_workers = std::max(std::thread::hardware_concurrency(), 1u);
+        // a batch at least this big counts as pressure, 0 means 3/4 of queue_capacity
+        std::size_t grow_batch_threshold = 0;
+        // number of consecutive pressure reports before a worker is added
+        std::size_t grow_pressure_rounds = 4;
+        std::chrono::steady_clock::duration idle_timeout = std::chrono::seconds(1);
+        // the last worker stays if stolen values kept it busy for at least this fraction of idle_timeout
+        double retire_utilisation = 0.25;
+        // empty rounds a worker yields through before parking on its queue
+        std::size_t idle_spins = 64;
+    };
+
+    template<typename T>
+    class threadpool
+    {
+    public:
+        using value_type = T;
+        using worker_type = thread_worker<value_type>;
+        using clock_type = std::chrono::steady_clock;
+
+        threadpool() : threadpool(threadpool_options()) {}
+        threadpool(const threadpool&) = delete;
+        threadpool& operator=(const threadpool&) = delete;
+        threadpool(threadpool&&) = delete;
+        threadpool& operator=(threadpool&&) = delete;
+
+        explicit threadpool(const threadpool_options& opts)
+            : options(normalize(opts)), threads(options.max_workers), exited(options.max_workers)
+        {
+            this->workers.reserve(this->options.max_workers);
+            for (std::size_t i = 0; i < this->options.max_workers; ++i) {
+                this->workers.push_back(std::make_unique<worker_type>(this->options.queue_capacity, this->options.local_capacity));
+            }
+            try {
+                std::scoped_lock _(this->mutex);
+                for (std::size_t i = 0; i < this->options.min_workers; ++i) {
+                    this->activate_next();
+                }
+            } catch (...) {
+                // the workers already running would never leave worker_loop on their own
+                this->stop();
+                throw;
+            }
+        }
+
+        ~threadpool() {
+            this->stop();
+            // every owner has exited, run whatever is left on this thread
+            for (auto& w : this->workers) {
+                while (w->run_once() != 0) {}
+            }
+        }
+
+        std::size_t active_workers() const noexcept { return this->active_count.load(std::memory_order_relaxed); }
+        std::size_t max_workers() const noexcept { return this->options.max_workers; }
+
+        // Worker of this pool whose job is running on the calling thread, if any.
+        worker_type* current_worker() const noexcept {
+            auto* const w = worker_type::current();
+            return w != nullptr && this->index_of(*w) < this->workers.size() ? w : nullptr;
+        }
+
+        // Any thread.
+        // Returns false if every active worker's queue is full.
+        bool submit(value_type&& v) noexcept {
+            thread_local std::size_t next_worker = 0;
+            const auto active = std::max(this->active_count.load(std::memory_order_relaxed), 1uz);
+            const auto spread = this->spread(active);
+            for (std::size_t i = 0; i < active; ++i) {
+                // the retirement candidate is only tried when the others are full
+                const auto index = i < spread ? next_worker++ % spread : active - 1;
+                if (this->workers[index]->enqueue(std::move(v))) {
+                    this->check_retired(index);
+                    return true;
+                }
+                this->report_pressure();
+            }
+            return false;
+        }
+
+        // Any thread.
+        // Publishes make(0) ... make(count - 1) with one enqueue_bulk per worker.
+        // Returns n such that values [0, n) are accepted, make is only called for those.
+        template<typename F>
+            requires std::is_nothrow_invocable_r_v<value_type, F&, std::size_t>
+        std::size_t submit_bulk(std::size_t count, F&& make) noexcept {
+            thread_local std::size_t next_worker = 0;
+            const auto active = std::max(this->active_count.load(std::memory_order_relaxed), 1uz);
+            const auto spread = this->spread(active);
+            std::size_t done = 0;
+            for (std::size_t i = 0; i < active && done < count; ++i) {
+                const auto slots = (i < spread ? spread : active) - i;
+                const auto share = (count - done + slots - 1) / slots;
+                const auto index = i < spread ? next_worker++ % spread : active - 1;
+                const auto accepted = this->workers[index]->enqueue_bulk(share,
+                    [&make, done](std::size_t k) noexcept -> value_type { return make(done + k); });
+                if (accepted < share) {
+                    this->report_pressure();
+                }
+                if (accepted != 0) {
+                    this->check_retired(index);
+                }
+                done += accepted;
+            }
+            return done;
+        }
+
+        // Any thread, w must be one of this pool's workers (e.g. thread_worker::current() of a job).
+        // Like submit_bulk but everything goes to w, for continuations that return to where they started.
+        // Values that land on a retired worker are picked up by the survivors, as with submit.
+        template<typename F>
+            requires std::is_nothrow_invocable_r_v<value_type, F&, std::size_t>
+        std::size_t submit_bulk_to(worker_type& w, std::size_t count, F&& make) noexcept {
+            const auto accepted = w.enqueue_bulk(count, std::forward<F>(make));
+            if (accepted < count) {
+                this->report_pressure();
+            }
+            if (accepted != 0) {
+                this->check_retired(this->index_of(w));
+            }
+            return accepted;
+        }
+
+    private:
+        static threadpool_options normalize(threadpool_options opts) noexcept {
+            opts.max_workers = std::max(opts.max_workers, 1uz);
+            opts.min_workers = std::clamp(opts.min_workers, 1uz, opts.max_workers);
+            if (opts.grow_batch_threshold == 0) {
+                opts.grow_batch_threshold = std::max(opts.queue_capacity / 4 * 3, 1uz);
+            }
+            return opts;
+        }
+
+        // Number of workers producers spread values over.
+        // Without pressure the retirement candidate is left out, so that it can drain and age out.
+        std::size_t spread(std::size_t active) const noexcept {
+            if (active > this->options.min_workers && this->pressure.load(std::memory_order_relaxed) == 0) {
+                return active - 1;
+            }
+            return active;
+        }
+
+        std::size_t index_of(const worker_type& w) const noexcept {
+            const auto it = std::ranges::find_if(this->workers, [&w](const auto& p) { return p.get() == &w; });
+            return static_cast<std::size_t>(it - this->workers.begin());
+        }
+
+        void stop() noexcept {
+            {
+                std::scoped_lock _(this->mutex);
+                this->stopping.store(true, std::memory_order_relaxed);
+            }
+            for (auto& w : this->workers) {
+                w->wake();
+            }
+            this->threads.clear();
+        }
+
+        // requires mutex
+        // Returns false while the retired previous owner of the slot is still draining,
+        // growing runs on the submit path and must not wait for someone else's jobs.
+        bool activate_next() {
+            const auto index = this->active_count.load(std::memory_order_relaxed);
+            if (this->threads[index].joinable()) {
+                if (!this->exited[index].load(std::memory_order_acquire)) {
+                    return false;
+                }
+                // past its last value, only the thread exit itself is left to wait for
+                this->threads[index].join();
+            }
+            this->exited[index].store(false, std::memory_order_relaxed);
+            // the slot only goes live once its thread exists, a failed start leaves nothing behind
+            this->threads[index] = std::jthread([this, index] { this->worker_loop(index); });
+            this->started_count.store(std::max(this->started_count.load(std::memory_order_relaxed), index + 1), std::memory_order_release);
+            this->active_count.store(index + 1, std::memory_order_release);
+            // it may have looked at active_count before and parked without a deadline
+            this->workers[index]->wake();
+            return true;
+        }
+
+        void report_pressure() noexcept {
+            if (this->options.min_workers == this->options.max_workers) {
+                return;
+            }
+            if (this->pressure.fetch_add(1, std::memory_order_relaxed) + 1 < this->options.grow_pressure_rounds) {
+                return;
+            }
+            this->pressure.store(0, std::memory_order_relaxed);
+            std::unique_lock lock(this->mutex, std::try_to_lock);
+            if (lock.owns_lock()
+                && !this->stopping.load(std::memory_order_relaxed)
+                && this->active_count.load(std::memory_order_relaxed) < this->options.max_workers) {
+                try {
+                    this->activate_next();
+                } catch (...) {
+                    // failing to grow only costs throughput
+                }
+            }
+        }
+
+        // A producer may still pick a worker that is retiring.
+        // Either the retiring worker drains the value, or this sees the retirement
+        // and wakes worker 0, which will steal it (pairs with the fence in try_retire).
+        void check_retired(std::size_t index) noexcept {
+            if (index < this->options.min_workers) {
+                return;
+            }
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (index >= this->active_count.load(std::memory_order_relaxed)) {
+                this->workers[0]->wake();
+            }
+        }
+
+        bool retire_candidate(std::size_t index) const noexcept {
+            return index >= this->options.min_workers && index + 1 == this->active_count.load(std::memory_order_relaxed);
+        }
+
+        // Only the last active worker may retire, so active slots stay contiguous.
+        bool try_retire(std::size_t index) noexcept {
+            if (index < this->options.min_workers) {
+                return false;
+            }
+            std::unique_lock lock(this->mutex, std::try_to_lock);
+            if (!lock.owns_lock() || this->active_count.load(std::memory_order_relaxed) != index + 1) {
+                return false;
+            }
+            this->active_count.store(index, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            return true;
+        }
+
+        std::size_t steal_round(std::size_t index) {
+            auto& self = *this->workers[index];
+            const auto started = this->started_count.load(std::memory_order_acquire);
+            for (std::size_t i = 1; i < started; ++i) {
+                if (const auto executed = self.steal_from(*this->workers[(index + i) % started])) {
+                    return executed;
+                }
+            }
+            return 0;
+        }
+
+        void worker_loop(std::size_t index) {
+            auto& self = *this->workers[index];
+            auto idle_since = clock_type::now();
+            // time the retirement candidate spent on stolen values since idle_since
+            clock_type::duration helping = {};
+            const auto busy_enough = std::chrono::duration_cast<clock_type::duration>(
+                this->options.idle_timeout * this->options.retire_utilisation);
+            std::size_t idle_rounds = 0;
+            while (!this->stopping.load(std::memory_order_relaxed)) {
+                auto executed = self.run_once();
+                if (executed >= this->options.grow_batch_threshold) {
+                    this->report_pressure();
+                } else if (executed != 0 && this->pressure.load(std::memory_order_relaxed) != 0) {
+                    // pressure must be sustained
+                    this->pressure.store(0, std::memory_order_relaxed);
+                }
+                if (executed != 0) {
+                    idle_since = clock_type::now();
+                    helping = {};
+                    idle_rounds = 0;
+                    continue;
+                }
+                if (this->retire_candidate(index)) {
+                    // helping the others out only counts towards utilisation, not as own work
+                    const auto round_start = clock_type::now();
+                    if (this->steal_round(index) != 0) {
+                        helping += clock_type::now() - round_start;
+                        continue;
+                    }
+                    if (round_start - idle_since >= this->options.idle_timeout) {
+                        if (helping >= busy_enough) {
+                            idle_since = round_start;
+                            helping = {};
+                        } else if (this->try_retire(index)) {
+                            // the next candidate may be parked, let it start its own countdown
+                            if (this->retire_candidate(index - 1)) {
+                                this->workers[index - 1]->wake();
+                            }
+                            break;
+                        } else {
+                            // lost the mutex to a grow or the pool changed, look again
+                            std::this_thread::yield();
+                            continue;
+                        }
+                    }
+                    // sleep until the window closes, own values (pressure) or a stop request wake it earlier
+                    const auto ticket = self.prepare_park();
+                    if (this->stopping.load(std::memory_order_relaxed)) {
+                        self.cancel_park();
+                    } else {
+                        self.park_until(ticket, idle_since + this->options.idle_timeout);
+                    }
+                    continue;
+                }
+                executed = this->steal_round(index);
+                if (executed != 0) {
+                    idle_since = clock_type::now();
+                    idle_rounds = 0;
+                    continue;
+                }
+                if (++idle_rounds < this->options.idle_spins) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                const auto ticket = self.prepare_park();
+                // anything stealable, a stop request or becoming the retirement candidate
+                // (the pool just grew up to this worker) that slipped in before the ticket was taken
+                if (this->stopping.load(std::memory_order_relaxed) || this->retire_candidate(index) || this->steal_round(index) != 0) {
+                    self.cancel_park();
+                } else {
+                    self.park(ticket);
+                }
+                idle_since = clock_type::now();
+                idle_rounds = 0;
+            }
+            // hand in what is still pending, late producers are covered by survivors' steal
+            while (self.run_once() != 0) {}
+            this->exited[index].store(true, std::memory_order_release);
+        }
 
+        const threadpool_options options;
+        std::vector<std::unique_ptr<worker_type>> workers;
+        std::vector<std::jthread> threads;
+        // set by a worker thread once it has left worker_loop
+        std::vector<std::atomic_bool> exited;
+        std::mutex mutex;
+        alignas(std::hardware_destructive_interference_size) std::atomic_size_t active_count = 0;
+        std::atomic_size_t started_count = 0;
+        std::atomic_bool stopping = false;
+        alignas(std::hardware_destructive_interference_size) std::atomic_size_t pressure = 0;
+    };
 
 } // namespace mylib
 
@@ -0,0 +1,401 @@
+#ifndef MYLIB_TRACE_H
+#define MYLIB_TRACE_H 1
+
+/*
+    * Header file for queue event tracing
+    *
+    * Define MYLIB_TRACE to record enqueue, drain, wait, steal and execute events
+    * into per-thread ring buffers, and dump them as Chrome / Perfetto trace JSON.
+    * Without MYLIB_TRACE every hook is an empty inline function and compiles to nothing.
+    *
+    * Each thread is the only writer of its buffer, a record is a handful of relaxed stores
+    * guarded by a per-event sequence number, so a dump can run while threads keep recording.
+    * Old events are overwritten once a buffer wraps (MYLIB_TRACE_CAPACITY events per thread).
+    * A buffer goes back to a free list when its thread exits and the next new thread records into it,
+    * so a pool that keeps growing and shrinking holds as many buffers as it ever had threads at once.
+    *
+    * Values going through a concurrent_queue whose consumer records execute events (the shared queue
+    * of a thread_worker, see concurrent_queue::trace_flows) carry a flow id from enqueue to execute,
+    * dumped as Chrome flow events ("s" / "f"), so the time each value spent queued shows up as an arrow.
+*/
+
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <ios>
+#include <ostream>
+
+#ifdef MYLIB_TRACE
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#endif
+
+#ifndef MYLIB_TRACE_CAPACITY
+#define MYLIB_TRACE_CAPACITY (1 << 16)
+#endif
+
+namespace mylib::trace {
+
+    enum class event_kind : std::uint32_t
+    {
+        enqueue,    // producer published count values into queue
+        drain,      // owner took a batch of count values from queue
+        wait,       // owner or thief waited on leaving_counter of queue
+        steal,      // thief took a batch of count values from queue
+        execute,    // one value from queue ran
+    };
+
+#ifdef MYLIB_TRACE
+    // Follows one value through a queue, 0 when there is nothing to follow.
+    struct flow
+    {
+        flow at(std::size_t i) const noexcept { return flow{ this->id != 0 ? this->id + i : 0 }; }
+
+        std::uint64_t id = 0;
+    };
+#else
+    struct flow
+    {
+        flow at(std::size_t) const noexcept { return flow{}; }
+    };
+#endif
+
+    inline constexpr const char* event_name(event_kind kind) noexcept {
+        switch (kind) {
+            case event_kind::enqueue: return "enqueue";
+            case event_kind::drain: return "drain";
+            case event_kind::wait: return "wait";
+            case event_kind::steal: return "steal";
+            case event_kind::execute: return "execute";
+        }
+        return "unknown";
+    }
+
+#ifdef MYLIB_TRACE
+
+    inline constexpr bool enabled = true;
+
+    using timestamp = std::uint64_t;
+
+    inline timestamp now() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+        return __builtin_ia32_rdtsc();
+#else
+        return static_cast<timestamp>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+    }
+
+    namespace details {
+
+        struct event
+        {
+            // index + 1 of the record stored here, 0 while being written
+            std::atomic_uint64_t sequence = 0;
+            std::atomic_uint64_t begin = 0;
+            std::atomic_uint64_t end = 0;
+            std::atomic_uint64_t queue = 0;
+            std::atomic_uint64_t kind_and_count = 0;
+            // first flow id, one per counted value of an enqueue, the value's own for an execute
+            std::atomic_uint64_t flow = 0;
+        };
+
+        struct alignas(std::hardware_destructive_interference_size) thread_buffer
+        {
+            constexpr static std::size_t capacity = MYLIB_TRACE_CAPACITY;
+            static_assert((capacity & (capacity - 1)) == 0, "MYLIB_TRACE_CAPACITY must be a power of 2");
+
+            explicit thread_buffer(std::size_t id) noexcept : id(id) {}
+
+            // Flow ids are unique across threads, the buffer id is in the top bits.
+            trace::flow reserve_flows(std::size_t count) noexcept {
+                const auto first = this->flows;
+                this->flows += count;
+                return trace::flow{ (static_cast<std::uint64_t>(this->id + 1) << 40) | (first & ((1ull << 40) - 1)) };
+            }
+
+            void record(event_kind kind, const void* queue, std::size_t count, timestamp begin, timestamp end, trace::flow flow) noexcept {
+                const auto index = this->head.load(std::memory_order_relaxed);
+                event& e = this->events[index & (capacity - 1)];
+                e.sequence.store(0, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+                e.begin.store(begin, std::memory_order_relaxed);
+                e.end.store(end, std::memory_order_relaxed);
+                e.queue.store(reinterpret_cast<std::uintptr_t>(queue), std::memory_order_relaxed);
+                e.kind_and_count.store((static_cast<std::uint64_t>(kind) << 56) | (count & ((1ull << 56) - 1)), std::memory_order_relaxed);
+                e.flow.store(flow.id, std::memory_order_relaxed);
+                e.sequence.store(index + 1, std::memory_order_release);
+                this->head.store(index + 1, std::memory_order_relaxed);
+            }
+
+            const std::size_t id;
+            std::atomic_uint64_t head = 0;
+            // owner only, carries on where the previous owner of a recycled buffer stopped
+            std::uint64_t flows = 0;
+            std::array<event, capacity> events;
+        };
+
+        struct registry
+        {
+            registry() noexcept
+                : origin_ticks(now()), origin_time(std::chrono::steady_clock::now())
+            {}
+
+            thread_buffer& add() {
+                std::scoped_lock _(this->mutex);
+                if (!this->free.empty()) {
+                    thread_buffer* const b = this->free.back();
+                    this->free.pop_back();
+                    return *b;
+                }
+                auto& b = *this->buffers.emplace_back(std::make_unique<thread_buffer>(this->buffers.size()));
+                // so that remove never allocates
+                this->free.reserve(this->buffers.size());
+                return b;
+            }
+
+            // Events stay in the buffer until its next owner overwrites them.
+            void remove(thread_buffer& b) noexcept {
+                std::scoped_lock _(this->mutex);
+                this->free.push_back(&b);
+            }
+
+            const timestamp origin_ticks;
+            const std::chrono::steady_clock::time_point origin_time;
+            std::mutex mutex;
+            std::vector<std::unique_ptr<thread_buffer>> buffers;
+            std::vector<thread_buffer*> free;
+        };
+
+        inline registry& get_registry() {
+            static registry r;
+            return r;
+        }
+
+        // Set once the thread gave its buffer back, events recorded later in its teardown are dropped.
+        inline thread_local bool local_buffer_returned = false;
+
+        // Hands the buffer of an exiting thread back to the registry.
+        struct buffer_owner
+        {
+            ~buffer_owner() {
+                if (this->buffer != nullptr) {
+                    get_registry().remove(*this->buffer);
+                    this->buffer = nullptr;
+                }
+                local_buffer_returned = true;
+            }
+
+            thread_buffer* buffer = nullptr;
+        };
+
+        inline thread_local buffer_owner local_buffer;
+
+        inline thread_buffer* get_local_buffer() {
+            if (local_buffer_returned) [[unlikely]] {
+                return nullptr;
+            }
+            if (local_buffer.buffer == nullptr) [[unlikely]] {
+                local_buffer.buffer = &get_registry().add();
+            }
+            return local_buffer.buffer;
+        }
+
+    } // namespace details
+
+    inline void record(event_kind kind, const void* queue, std::size_t count, timestamp begin, timestamp end, flow f = {}) noexcept {
+        try {
+            if (auto* const b = details::get_local_buffer()) {
+                b->record(kind, queue, count, begin, end, f);
+            }
+        } catch (...) {
+            // failing to register a buffer only loses the event
+        }
+    }
+
+    // Ids for count values about to be enqueued, pass the result to record.
+    inline flow reserve_flows(std::size_t count) noexcept {
+        try {
+            auto* const b = details::get_local_buffer();
+            return b ? b->reserve_flows(count) : flow{};
+        } catch (...) {
+            return flow{};
+        }
+    }
+
+    inline void instant(event_kind kind, const void* queue, std::size_t count) noexcept {
+        const auto t = now();
+        record(kind, queue, count, t, t);
+    }
+
+    class [[nodiscard]] span
+    {
+    public:
+        span(event_kind kind, const void* queue, flow f = {}) noexcept
+            : kind(kind), queue(queue), begin(now()), f(f)
+        {}
+        span(const span&) = delete;
+        span& operator=(const span&) = delete;
+
+        // empty batches are dropped so that idle polling does not flush the buffer
+        ~span() {
+            if (this->count != 0) {
+                record(this->kind, this->queue, this->count, this->begin, now(), this->f);
+            }
+        }
+
+        void set_count(std::size_t c) noexcept { this->count = c; }
+
+    private:
+        event_kind kind;
+        const void* queue;
+        timestamp begin;
+        flow f;
+        std::size_t count = 1;
+    };
+
+    // Writes every recorded event as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+    // Events being overwritten while dumping are skipped, and so are flows whose other end is gone.
+    inline void dump_chrome_trace(std::ostream& os) {
+        auto& r = details::get_registry();
+        // map ticks to microseconds since the registry was created
+        const auto ticks = now() - r.origin_ticks;
+        const auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - r.origin_time).count();
+        const double us_per_tick = ticks != 0 ? elapsed / static_cast<double>(ticks) : 0.0;
+        // events may start slightly before the registry does
+        const auto to_us = [&](timestamp t) { return static_cast<double>(static_cast<std::int64_t>(t - r.origin_ticks)) * us_per_tick; };
+
+        struct snapshot
+        {
+            std::size_t tid;
+            timestamp begin;
+            timestamp end;
+            std::uint64_t queue;
+            event_kind kind;
+            std::uint64_t count;
+            std::uint64_t flow;
+        };
+        // copy first, a flow is only written out when both of its ends are still in the buffers
+        std::vector<snapshot> events;
+        {
+            std::scoped_lock _(r.mutex);
+            for (const auto& b : r.buffers) {
+                const auto head = b->head.load(std::memory_order_acquire);
+                const auto tail = head > details::thread_buffer::capacity ? head - details::thread_buffer::capacity : 0;
+                for (auto index = tail; index < head; ++index) {
+                    const auto& e = b->events[index & (details::thread_buffer::capacity - 1)];
+                    if (e.sequence.load(std::memory_order_acquire) != index + 1) {
+                        continue;
+                    }
+                    const auto begin = e.begin.load(std::memory_order_relaxed);
+                    const auto end = e.end.load(std::memory_order_relaxed);
+                    const auto queue = e.queue.load(std::memory_order_relaxed);
+                    const auto kind_and_count = e.kind_and_count.load(std::memory_order_relaxed);
+                    const auto flow_id = e.flow.load(std::memory_order_relaxed);
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (e.sequence.load(std::memory_order_relaxed) != index + 1) {
+                        continue;
+                    }
+                    events.push_back(snapshot{ b->id, begin, end, queue, static_cast<event_kind>(kind_and_count >> 56),
+                        kind_and_count & ((1ull << 56) - 1), flow_id });
+                }
+            }
+        }
+        // started flows as [first, first + count) sorted by first, finished ones by id
+        std::vector<std::pair<std::uint64_t, std::uint64_t>> started;
+        std::unordered_set<std::uint64_t> finished;
+        for (const auto& e : events) {
+            if (e.flow == 0) {
+                continue;
+            }
+            if (e.kind == event_kind::enqueue) {
+                started.emplace_back(e.flow, e.count);
+            } else {
+                finished.insert(e.flow);
+            }
+        }
+        std::ranges::sort(started);
+        const auto was_started = [&started](std::uint64_t id) {
+            const auto it = std::ranges::upper_bound(started, std::pair<std::uint64_t, std::uint64_t>(id, ~0ull));
+            return it != started.begin() && id - std::prev(it)->first < std::prev(it)->second;
+        };
+
+        const auto flags = os.flags();
+        const auto precision = os.precision(3);
+        os << std::fixed << "{\"traceEvents\":[";
+        bool first = true;
+        for (const auto& e : events) {
+            os << (first ? "\n" : ",\n");
+            first = false;
+            os << "{\"name\":\"" << event_name(e.kind) << "\",\"cat\":\"queue\",\"pid\":1,\"tid\":" << e.tid
+               << ",\"ts\":" << to_us(e.begin);
+            if (e.begin == e.end) {
+                os << ",\"ph\":\"i\",\"s\":\"t\"";
+            } else {
+                os << ",\"ph\":\"X\",\"dur\":" << to_us(e.end) - to_us(e.begin);
+            }
+            os << ",\"args\":{\"queue\":\"0x" << std::hex << e.queue << std::dec
+               << "\",\"count\":" << e.count << "}}";
+            if (e.flow == 0) {
+                continue;
+            }
+            // a flow starts inside the enqueue slice and ends at the start of the execute slice
+            const auto flows = e.kind == event_kind::enqueue ? e.count : 1;
+            for (std::uint64_t i = 0; i < flows; ++i) {
+                const auto id = e.flow + i;
+                if (e.kind == event_kind::enqueue ? !finished.contains(id) : !was_started(id)) {
+                    continue;
+                }
+                os << ",\n{\"name\":\"queued\",\"cat\":\"flow\",\"pid\":1,\"tid\":" << e.tid
+                   << ",\"ts\":" << to_us(e.begin) << ",\"id\":" << id;
+                if (e.kind == event_kind::enqueue) {
+                    os << ",\"ph\":\"s\"}";
+                } else {
+                    os << ",\"ph\":\"f\",\"bp\":\"e\"}";
+                }
+            }
+        }
+        os << "\n]}\n";
+        os.flags(flags);
+        os.precision(precision);
+    }
+
+#else
+
+    inline constexpr bool enabled = false;
+
+    using timestamp = std::uint64_t;
+
+    inline timestamp now() noexcept { return 0; }
+
+    inline void record(event_kind, const void*, std::size_t, timestamp, timestamp, flow = {}) noexcept {}
+
+    inline flow reserve_flows(std::size_t) noexcept { return flow{}; }
+
+    inline void instant(event_kind, const void*, std::size_t) noexcept {}
+
+    class [[nodiscard]] span
+    {
+    public:
+        span(event_kind, const void*, flow = {}) noexcept {}
+        span(const span&) = delete;
+        span& operator=(const span&) = delete;
+
+        void set_count(std::size_t) noexcept {}
+    };
+
+    inline void dump_chrome_trace(std::ostream& os) { os << "{\"traceEvents\":[]}\n"; }
+
+#endif // MYLIB_TRACE
+
+} // namespace mylib::trace
+
+#endif // MYLIB_TRACE_H
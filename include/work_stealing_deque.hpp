@@ -0,0 +1,137 @@
+#ifndef MYLIB_WORK_STEALING_DEQUE_H
+#define MYLIB_WORK_STEALING_DEQUE_H 1
+
+/*
+    * Header file for work stealing deque implementation
+    *
+    * This file provides a bounded Chase-Lev style deque that is owned by ONE thread.
+    * The owner pushes and pops at the bottom (LIFO) without atomic RMW on the fast path,
+    * while any number of thieves take values from the top (FIFO).
+    * It is meant for values produced on the consumer thread itself,
+    * external producers should keep using concurrent_queue.
+*/
+
+#include <concepts>
+#include <cstddef>
+
+#include <bit>
+#include <new>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <type_traits>
+
+namespace mylib {
+
+    template<typename T>
+        requires std::default_initializable<T> && std::destructible<T> && (std::is_nothrow_move_assignable_v<T>)
+    class work_stealing_deque
+    {
+    public:
+        using value_type = T;
+        using index_type = std::ptrdiff_t;
+        constexpr static std::size_t deque_align = std::hardware_destructive_interference_size;
+
+        work_stealing_deque() = delete;
+        work_stealing_deque(const work_stealing_deque&) = delete;
+        work_stealing_deque& operator=(const work_stealing_deque&) = delete;
+        work_stealing_deque(work_stealing_deque&&) = delete;
+        work_stealing_deque& operator=(work_stealing_deque&&) = delete;
+
+        // capacity is rounded up to power of 2
+        explicit work_stealing_deque(std::size_t capacity)
+            : cells(std::make_unique<deque_cell[]>(std::bit_ceil(capacity)))
+            , mask(std::bit_ceil(capacity) - 1)
+        {
+            for (std::size_t i = 0; i <= this->mask; ++i) {
+                this->cells[i].turn.store(static_cast<index_type>(i), std::memory_order_relaxed);
+            }
+        }
+
+        std::size_t capacity() const noexcept { return this->mask + 1; }
+
+        // Only a hint when called from a thread other than the owner.
+        bool empty() const noexcept {
+            return this->bottom.load(std::memory_order_relaxed) <= this->top.load(std::memory_order_relaxed);
+        }
+
+        // Owner only.
+        // Fails when the deque is full, or a thief has not finished moving out the value
+        // that previously occupied the slot. v is left untouched in that case.
+        bool push(value_type&& v) noexcept {
+            const auto b = this->bottom.load(std::memory_order_relaxed);
+            deque_cell& cell = this->cell_at(b);
+            if (cell.turn.load(std::memory_order_acquire) != b) {
+                return false;
+            }
+            cell.value = std::move(v);
+            this->bottom.store(b + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Owner only.
+        std::optional<value_type> pop() noexcept {
+            const auto b = this->bottom.load(std::memory_order_relaxed) - 1;
+            this->bottom.store(b, std::memory_order_release);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto t = this->top.load(std::memory_order_relaxed);
+            if (t > b) {
+                this->bottom.store(b + 1, std::memory_order_release);
+                return std::nullopt;
+            }
+            deque_cell& cell = this->cell_at(b);
+            if (t < b) {
+                // no thief can reach this slot, and next push reuses it directly
+                return std::optional<value_type>(std::move(cell.value));
+            }
+            // last value, race with thieves
+            const bool won = this->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            this->bottom.store(b + 1, std::memory_order_release);
+            if (!won) {
+                return std::nullopt;
+            }
+            std::optional<value_type> result(std::move(cell.value));
+            cell.turn.store(b + static_cast<index_type>(capacity()), std::memory_order_relaxed);
+            return result;
+        }
+
+        // Any thread.
+        // Returns nothing if the deque is empty or another thread won the race.
+        std::optional<value_type> steal() noexcept {
+            auto t = this->top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const auto b = this->bottom.load(std::memory_order_acquire);
+            if (t >= b) {
+                return std::nullopt;
+            }
+            if (!this->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return std::nullopt;
+            }
+            // slot is ours until turn moves on, owner will not overwrite it before that
+            deque_cell& cell = this->cell_at(t);
+            std::optional<value_type> result(std::move(cell.value));
+            cell.turn.store(t + static_cast<index_type>(capacity()), std::memory_order_release);
+            return result;
+        }
+
+    private:
+        struct alignas(deque_align) deque_cell
+        {
+            // index of the next push allowed to write into this cell
+            std::atomic<index_type> turn = 0;
+            value_type value;
+        };
+
+        deque_cell& cell_at(index_type index) noexcept {
+            return this->cells[static_cast<std::size_t>(index) & this->mask];
+        }
+
+        const std::unique_ptr<deque_cell[]> cells;
+        const std::size_t mask;
+        alignas(deque_align) std::atomic<index_type> top = 0;
+        alignas(deque_align) std::atomic<index_type> bottom = 0;
+    };
+
+} // namespace mylib
+
+#endif // MYLIB_WORK_STEALING_DEQUE_H
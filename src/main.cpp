@@ -1,11 +1,34 @@
 #include <thread>
 #include <atomic>
 #include <functional>
+#include <exception>
 #include <vector>
+#include <memory>
+#include <algorithm>
 #include <ranges>
+#include <chrono>
 #include <print>
+#include <fstream>
+#include <array>
+#include <span>
+#include <system_error>
 
 #include "concurrent_queue.hpp"
+#include "thread_worker.hpp"
+#include "threadpool.hpp"
+#include "scheduler.hpp"
+#include "trace.hpp"
+#include "shm_queue.hpp"
+#include "io_reactor.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 #ifdef __cpp_lib_move_only_function
 using job = std::move_only_function<void()>;
@@ -122,7 +145,13 @@ void test_2() {
                 DEBUG_PRINT("Consumer 1 stole {} jobs from queue 2.", jobs.size());
                 cs1 += jobs.size();
                 if (jobs.empty()) {
-                    std::this_thread::yield();
+                    const auto ticket = queue1.prepare_park();
+                    if (job_counter.load(std::memory_order_relaxed) < (thrd_cnt - 2) * total_jobs) {
+                        DEBUG_PRINT("Consumer 1 parks.");
+                        queue1.park(ticket);
+                    } else {
+                        queue1.cancel_park();
+                    }
                     continue;
                 }
             }
@@ -131,6 +160,8 @@ void test_2() {
                 j();
             }
         }
+        // the other consumer may be parked on an empty queue
+        queue2.wake();
     });
     std::jthread consumer2([&c2, &cs2, &queue1, &queue2, &job_counter, &consumer_flag, thrd_cnt] {
         local_job = "Consumer 2 executed the job";
@@ -150,7 +181,13 @@ void test_2() {
                 DEBUG_PRINT("Consumer 2 stole {} jobs from queue 1.", jobs.size());
                 cs2 += jobs.size();
                 if (jobs.empty()) {
-                    std::this_thread::yield();
+                    const auto ticket = queue2.prepare_park();
+                    if (job_counter.load(std::memory_order_relaxed) < (thrd_cnt - 2) * total_jobs) {
+                        DEBUG_PRINT("Consumer 2 parks.");
+                        queue2.park(ticket);
+                    } else {
+                        queue2.cancel_park();
+                    }
                     continue;
                 }
             }
@@ -159,6 +196,8 @@ void test_2() {
                 j();
             }
         }
+        // the other consumer may be parked on an empty queue
+        queue1.wake();
     });
     flag.store(true, std::memory_order_relaxed);
     consumer_flag.store(true, std::memory_order_relaxed);
@@ -176,6 +215,537 @@ void test_2() {
     std::println("Consumer 1 stole {} jobs, Consumer 2 stole {} jobs.", cs1, cs2);
 }
 
+void test_3() {
+    using namespace std::literals;
+    using worker_type = mylib::thread_worker<job>;
+    constexpr static std::size_t queue_capacity = 1024;
+    constexpr static std::size_t local_capacity = 256;
+    constexpr static std::size_t total_jobs = queue_capacity * 1024;
+    constexpr static std::size_t children_per_job = 3;
+    worker_type worker1(queue_capacity, local_capacity), worker2(queue_capacity, local_capacity);
+    std::vector<std::jthread> producers;
+    const auto thrd_cnt = std::max(std::thread::hardware_concurrency(), 3u);
+    DEBUG_PRINT("Thread count: {}", thrd_cnt);
+    producers.reserve(thrd_cnt - 2);
+    std::atomic_bool flag = false;
+    std::atomic_size_t job_counter = 0;
+    const std::size_t expected_jobs = (thrd_cnt - 2) * total_jobs * (children_per_job + 1);
+    for (auto i : std::views::iota(0u, thrd_cnt - 2)) {
+        producers.emplace_back([&worker1, &worker2, &flag, i, &job_counter] {
+            while (!flag.load(std::memory_order_relaxed)) {
+                std::this_thread::yield();
+            }
+            for (auto j : std::views::iota(0uz, total_jobs)) {
+                auto new_job = [&job_counter] {
+                    job_counter.fetch_add(1, std::memory_order_relaxed);
+                    // spawned jobs stay on the local deque of the worker running this job
+                    for ([[maybe_unused]] auto k : std::views::iota(0uz, children_per_job)) {
+                        while (!worker_type::current()->spawn([&job_counter] {
+                            job_counter.fetch_add(1, std::memory_order_relaxed);
+                        })) {
+                            std::this_thread::yield();
+                        }
+                    }
+                };
+                auto& target = j % 3 == 0 ? worker1 : worker2;
+                while (!target.enqueue(std::move(new_job))) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    std::size_t c1 = 0, c2 = 0;
+    auto consume = [&job_counter, expected_jobs](worker_type& self, worker_type& victim, std::size_t& counter) {
+        while (job_counter.load(std::memory_order_relaxed) < expected_jobs) {
+            auto executed = self.run_once();
+            if (executed == 0) {
+                executed = self.steal_from(victim);
+                if (executed == 0) {
+                    std::this_thread::yield();
+                    continue;
+                }
+            }
+            counter += executed;
+        }
+    };
+    std::jthread consumer1([&] { consume(worker1, worker2, c1); });
+    std::jthread consumer2([&] { consume(worker2, worker1, c2); });
+    flag.store(true, std::memory_order_relaxed);
+    producers.clear();
+    consumer1.join();
+    consumer2.join();
+    const auto final_job_count = job_counter.load(std::memory_order_relaxed);
+    std::println("Total jobs processed: {}", final_job_count);
+    if (c1 + c2 != final_job_count) {
+        std::println("Counter mismatch: {} + {} != {}", c1, c2, final_job_count);
+    } else {
+        std::println("All jobs executed successfully.");
+    }
+    std::println("Worker 1 processed {} jobs, Worker 2 processed {} jobs.", c1, c2);
+}
+
+void test_4() {
+    using namespace std::literals;
+    constexpr static std::size_t total_jobs = 1024 * 4096;
+    constexpr static std::size_t trickle_jobs = 256;
+    const auto thrd_cnt = std::max(std::thread::hardware_concurrency(), 2u);
+    mylib::threadpool_options options;
+    options.min_workers = 1;
+    options.max_workers = thrd_cnt;
+    options.idle_timeout = 50ms;
+    std::atomic_size_t job_counter = 0;
+    mylib::threadpool<job> pool(options);
+    std::println("Workers at start: {}", pool.active_workers());
+    std::size_t peak = pool.active_workers();
+    for ([[maybe_unused]] auto j : std::views::iota(0uz, total_jobs)) {
+        while (!pool.submit([&job_counter] {
+            job_counter.fetch_add(1, std::memory_order_relaxed);
+        })) {
+            std::this_thread::yield();
+        }
+        peak = std::max(peak, pool.active_workers());
+    }
+    std::println("Workers at peak: {}", peak);
+    // light traffic must not keep the grown pool alive
+    for ([[maybe_unused]] auto j : std::views::iota(0uz, trickle_jobs)) {
+        while (!pool.submit([&job_counter] {
+            job_counter.fetch_add(1, std::memory_order_relaxed);
+        })) {
+            std::this_thread::yield();
+        }
+        std::this_thread::sleep_for(5ms);
+    }
+    while (job_counter.load(std::memory_order_relaxed) < total_jobs + trickle_jobs) {
+        std::this_thread::yield();
+    }
+    const auto after_trickle = pool.active_workers();
+    std::println("Workers after light traffic: {}", after_trickle);
+    std::println("Total jobs processed: {}", job_counter.load(std::memory_order_relaxed));
+    if (peak <= options.min_workers || after_trickle != options.min_workers
+        || job_counter.load(std::memory_order_relaxed) != total_jobs + trickle_jobs) {
+        std::println("Elastic pool mismatch: peak {}, after light traffic {}, {} jobs",
+            peak, after_trickle, job_counter.load(std::memory_order_relaxed));
+    } else {
+        std::println("Pool grew under pressure and shrank back under light traffic.");
+    }
+}
+
+struct flag_receiver {
+    void set_value() && noexcept { done->store(true, std::memory_order_release); }
+    void set_error(std::exception_ptr) && noexcept { failed->store(true, std::memory_order_relaxed); std::move(*this).set_value(); }
+    void set_stopped() && noexcept { std::move(*this).set_value(); }
+    std::atomic_bool* done;
+    std::atomic_bool* failed;
+};
+
+void test_5() {
+    using namespace std::literals;
+    constexpr static std::size_t total_ops = 1024 * 64;
+    constexpr static std::size_t bulk_shape = 1024 * 1024;
+    mylib::threadpool<job> pool;
+    mylib::threadpool_scheduler scheduler(pool);
+    std::atomic_bool failed = false;
+    std::size_t scheduled = 0;
+    for ([[maybe_unused]] auto i : std::views::iota(0uz, total_ops)) {
+        std::atomic_bool done = false;
+        auto op = scheduler.schedule().connect(flag_receiver{ &done, &failed });
+        op.start();
+        while (!done.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        ++scheduled;
+    }
+    std::atomic_bool done = false;
+    std::vector<std::size_t> values(bulk_shape, 0);
+    auto op = scheduler.schedule_bulk(bulk_shape, [&values](std::size_t i) { values[i] = i; })
+        .connect(flag_receiver{ &done, &failed });
+    op.start();
+    while (!done.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+    const bool bulk_ok = std::ranges::equal(values, std::views::iota(0uz, bulk_shape));
+    std::println("Scheduled {} operations, bulk {}.", scheduled, bulk_ok && !failed.load() ? "succeeded" : "failed");
+
+    // started from a job on the only worker, with queues too small to hold everything
+    constexpr static std::size_t nested_ops = 64;
+    constexpr static std::size_t nested_shape = 4096;
+    std::vector<std::atomic_bool> nested_done(nested_ops + 1);
+    std::vector<std::size_t> nested_values(nested_shape, 0);
+    std::vector<std::shared_ptr<void>> operations;
+    mylib::threadpool_options options;
+    options.queue_capacity = 4;
+    options.local_capacity = 4;
+    options.min_workers = 1;
+    options.max_workers = 1;
+    mylib::threadpool<job> small_pool(options);
+    mylib::threadpool_scheduler small_scheduler(small_pool);
+    while (!small_pool.submit([&] {
+        for (auto i : std::views::iota(0uz, nested_ops)) {
+            auto* const nested = new auto(small_scheduler.schedule().connect(flag_receiver{ &nested_done[i], &failed }));
+            operations.emplace_back(nested);
+            nested->start();
+        }
+        auto* const nested = new auto(small_scheduler.schedule_bulk(nested_shape, [&nested_values](std::size_t i) { nested_values[i] = i; })
+            .connect(flag_receiver{ &nested_done[nested_ops], &failed }));
+        operations.emplace_back(nested);
+        nested->start();
+    })) {
+        std::this_thread::yield();
+    }
+    for (const auto& d : nested_done) {
+        while (!d.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+    }
+    const bool nested_ok = std::ranges::equal(nested_values, std::views::iota(0uz, nested_shape));
+    std::println("Scheduled {} operations and bulk from a saturated worker, {}.", nested_ops,
+        nested_ok && !failed.load() ? "succeeded" : "failed");
+}
+
+void test_6() {
+    using namespace std::literals;
+    constexpr static std::size_t queue_capacity = 1024;
+    constexpr static std::size_t total_jobs = queue_capacity * 256;
+    // two producer buffers, two batches held by the consumer
+    mylib::concurrent_queue<job, 4> queue(queue_capacity);
+    std::vector<std::jthread> producers;
+    const auto thrd_cnt = std::max(std::thread::hardware_concurrency(), 2u);
+    producers.reserve(thrd_cnt - 1);
+    std::atomic_size_t job_counter = 0;
+    for ([[maybe_unused]] auto i : std::views::iota(0u, thrd_cnt - 1)) {
+        producers.emplace_back([&queue, &job_counter] {
+            for ([[maybe_unused]] auto j : std::views::iota(0uz, total_jobs)) {
+                while (!queue.enqueue([&job_counter] {
+                    job_counter.fetch_add(1, std::memory_order_relaxed);
+                })) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    std::size_t counter = 0;
+    std::size_t overlapped = 0;
+    auto current = queue.wait_for_exclusive_values();
+    while (counter < (thrd_cnt - 1) * total_jobs) {
+        // take the next batch before running the current one, producers keep filling meanwhile
+        auto next = queue.wait_for_exclusive_values();
+        if (!current.empty() && !next.empty()) {
+            ++overlapped;
+        }
+        for (auto& j : current) {
+            j();
+            ++counter;
+        }
+        current = std::move(next);
+    }
+    producers.clear();
+    std::println("Total jobs processed: {}", job_counter.load(std::memory_order_relaxed));
+    if (counter != job_counter.load(std::memory_order_relaxed)) {
+        std::println("Counter mismatch: {} != {}", counter, job_counter.load(std::memory_order_relaxed));
+    } else {
+        std::println("All jobs executed successfully.");
+    }
+    std::println("{} batches were fetched while the previous one was pending.", overlapped);
+}
+
+#ifdef __linux__
+void test_7() {
+    using namespace std::literals;
+    constexpr static std::size_t queue_capacity = 256;
+    constexpr static std::size_t victim_messages = queue_capacity * 4;
+    constexpr static std::size_t producer_count = 3;
+    struct message
+    {
+        std::size_t producer;
+        std::size_t sequence;
+    };
+    // the other producers keep publishing until the consumer has given up on the cell of the dead one
+    struct shared_state
+    {
+        std::atomic_bool stop;
+        std::atomic_size_t sent[producer_count + 1];
+    };
+    void* const shared = ::mmap(nullptr, sizeof(shared_state), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    auto* const state = new(shared) shared_state{};
+    mylib::shm_consumer<message> queue(queue_capacity, producer_count + 1);
+    std::vector<::pid_t> children;
+    // producer 0 is killed inside its publish
+    for (auto p : std::views::iota(0uz, producer_count + 1)) {
+        const ::pid_t pid = ::fork();
+        if (pid == 0) {
+            mylib::shm_producer<message> producer(queue.native_handle());
+            std::size_t j = 0;
+            while (p == 0 ? j < victim_messages : !state->stop.load(std::memory_order_relaxed)) {
+                if (producer.enqueue(message{ p, j })) {
+                    ++j;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+            state->sent[p].store(j, std::memory_order_relaxed);
+            if (p == 0) {
+                while (!producer.publish([](message&) noexcept { ::_exit(0); })) {
+                    std::this_thread::yield();
+                }
+            }
+            ::_exit(0);
+        }
+        children.push_back(pid);
+    }
+    std::vector<std::size_t> next_sequence(producer_count + 1, 0);
+    std::size_t counter = 0;
+    std::size_t abandoned = 0;
+    std::size_t out_of_order = 0;
+    std::size_t running = children.size();
+    std::size_t quiet_rounds = 0;
+    const auto deadline = std::chrono::steady_clock::now() + 10s;
+    // after every child exited, two empty drains in a row mean nothing is left
+    while (running != 0 || quiet_rounds < 2) {
+        auto values = queue.wait_for_exclusive_values();
+        abandoned += values.abandoned();
+        for (const auto& m : values) {
+            if (m.sequence != next_sequence[m.producer]++) {
+                ++out_of_order;
+            }
+            ++counter;
+        }
+        if (abandoned != 0 || std::chrono::steady_clock::now() >= deadline) {
+            state->stop.store(true, std::memory_order_relaxed);
+        }
+        if (values.empty() && values.abandoned() == 0) {
+            ++quiet_rounds;
+            for (auto& pid : children) {
+                if (pid != 0 && ::waitpid(pid, nullptr, WNOHANG) == pid) {
+                    pid = 0;
+                    --running;
+                }
+            }
+            std::this_thread::yield();
+        } else {
+            quiet_rounds = 0;
+        }
+    }
+    std::size_t expected = 0;
+    for (const auto& sent : state->sent) {
+        expected += sent.load(std::memory_order_relaxed);
+    }
+    ::munmap(shared, sizeof(shared_state));
+    std::println("Total messages received across processes: {}, abandoned cells: {}", counter, abandoned);
+    if (counter != expected || out_of_order != 0 || abandoned != 1) {
+        std::println("Mismatch: expected {} messages and 1 abandoned cell, {} out of order", expected, out_of_order);
+    } else {
+        std::println("All messages received successfully.");
+    }
+}
+void test_8(mylib::io_backend backend) {
+    using namespace std::literals;
+    constexpr static std::size_t rounds = 256;
+    constexpr static std::size_t block_size = 64;
+    // regular file (memfd), pipe and eventfd, read / written from jobs through the reactor
+    const int file_fd = ::memfd_create("test_8", MFD_CLOEXEC);
+    int pipe_fds[2];
+    [[maybe_unused]] const auto _ = ::pipe2(pipe_fds, O_CLOEXEC);
+    const int event_fd = ::eventfd(0, EFD_CLOEXEC);
+    std::vector<char> file_content(rounds * block_size);
+    for (auto i : std::views::iota(0uz, file_content.size())) {
+        file_content[i] = static_cast<char>('a' + i % 26);
+    }
+    [[maybe_unused]] const auto written = ::pwrite(file_fd, file_content.data(), file_content.size(), 0);
+    std::vector<std::array<char, block_size>> file_buffers(rounds);
+    std::vector<std::uint64_t> pipe_out(rounds);
+    std::vector<std::uint64_t> pipe_in(rounds);
+    std::uint64_t event_value = 0;
+    std::atomic_size_t completed = 0;
+    std::atomic_size_t failed = 0;
+    std::atomic_size_t on_owner = 0;
+    std::atomic_uint64_t pipe_sum = 0;
+    // elastic, so that the owner of a pending read may retire before it completes
+    mylib::threadpool_options options;
+    options.queue_capacity = 16;
+    options.min_workers = 1;
+    options.max_workers = std::max(std::thread::hardware_concurrency(), 2u);
+    options.grow_pressure_rounds = 1;
+    options.idle_timeout = 10ms;
+    // declared last, so that both are gone before the buffers
+    mylib::threadpool<job> pool(options);
+    mylib::io_reactor<job> reactor(pool, 1024, backend);
+    const auto done = [&](mylib::thread_worker<job>* owner, bool ok) {
+        // stealing may move a continuation to another worker, but never off the pool
+        const auto current = mylib::thread_worker<job>::current();
+        if (!ok || current == nullptr) {
+            failed.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (current == owner) {
+            on_owner.fetch_add(1, std::memory_order_relaxed);
+        }
+        completed.fetch_add(1, std::memory_order_release);
+    };
+    const auto submit = [&](std::size_t i) {
+        while (!pool.submit([&, i] {
+            auto* const self = mylib::thread_worker<job>::current();
+            while (!reactor.read(*self, file_fd, file_buffers[i].data(), block_size, static_cast<std::int64_t>(i * block_size),
+                [&, self, i](std::int64_t result) {
+                    done(self, result == block_size
+                        && std::ranges::equal(file_buffers[i], std::span(file_content).subspan(i * block_size, block_size)));
+                })) {
+                std::this_thread::yield();
+            }
+            while (!reactor.read(*self, pipe_fds[0], &pipe_in[i], sizeof(std::uint64_t), -1, [&, self, i](std::int64_t result) {
+                pipe_sum.fetch_add(pipe_in[i], std::memory_order_relaxed);
+                done(self, result == sizeof(std::uint64_t));
+            })) {
+                std::this_thread::yield();
+            }
+            pipe_out[i] = i + 1;
+            while (!reactor.write(*self, pipe_fds[1], &pipe_out[i], sizeof(std::uint64_t), -1, [&, self](std::int64_t result) {
+                done(self, result == sizeof(std::uint64_t));
+            })) {
+                std::this_thread::yield();
+            }
+        })) {
+            std::this_thread::yield();
+        }
+    };
+    while (!pool.submit([&] {
+        auto* const self = mylib::thread_worker<job>::current();
+        // nobody has signalled yet, the job returns and the read stays pending
+        while (!reactor.read(*self, event_fd, &event_value, sizeof(event_value), -1, [&, self](std::int64_t result) {
+            done(self, result == sizeof(event_value) && event_value != 0);
+        })) {
+            std::this_thread::yield();
+        }
+    })) {
+        std::this_thread::yield();
+    }
+    for (auto i : std::views::iota(0uz, rounds)) {
+        submit(i);
+    }
+    constexpr static std::size_t expected = rounds * 3 + 1;
+    while (completed.load(std::memory_order_acquire) < expected - 1) {
+        std::this_thread::sleep_for(1ms);
+    }
+    // let grown workers retire, survivors must still run the eventfd continuation
+    std::this_thread::sleep_for(options.idle_timeout * options.max_workers * 4);
+    const std::uint64_t one = 1;
+    [[maybe_unused]] const auto signalled = ::write(event_fd, &one, sizeof(one));
+    const auto deadline = std::chrono::steady_clock::now() + 2s;
+    while (completed.load(std::memory_order_acquire) < expected && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(1ms);
+    }
+    std::println("Backend {}: {} completions, {} ran on the submitting worker.",
+        reactor.backend() == mylib::io_backend::io_uring ? "io_uring" : "epoll", completed.load(), on_owner.load());
+    if (completed.load() != expected || failed.load() != 0 || pipe_sum.load() != rounds * (rounds + 1) / 2) {
+        std::println("{} of {} completions ran, {} failed, pipe sum {} != {}",
+            completed.load(), expected, failed.load(), pipe_sum.load(), rounds * (rounds + 1) / 2);
+    } else {
+        std::println("All I/O completed successfully.");
+    }
+    ::close(file_fd);
+    ::close(pipe_fds[0]);
+    ::close(pipe_fds[1]);
+    ::close(event_fd);
+}
+
+// The generation counter starts just below its 32-bit wrap-around, with buffers stamped as if left over
+// from the next cycle (or fresh, 0). Each round the last message is still being written when the consumer
+// drains, so it must be waited for instead of a stale or never written cell being taken as committed.
+// Every round sends one message more than the previous one, so that cell has not been written since.
+void test_9() {
+    using namespace std::literals;
+    using cell_type = mylib::shm_consumer<std::size_t>::cell_type;
+    constexpr static std::size_t queue_capacity = 64;
+    constexpr static std::size_t rounds = 8;
+    constexpr static std::size_t round_messages = 16;
+    mylib::shm_consumer<std::size_t> queue(queue_capacity, 1);
+    struct ::stat st;
+    if (::fstat(queue.native_handle(), &st) != 0) {
+        throw std::system_error(errno, std::generic_category(), "fstat");
+    }
+    const auto segment_size = static_cast<std::size_t>(st.st_size);
+    void* const segment = ::mmap(nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, queue.native_handle(), 0);
+    if (segment == MAP_FAILED) {
+        throw std::system_error(errno, std::generic_category(), "mmap");
+    }
+    // rewind to the end of a cycle before any producer attaches,
+    // the buffers first used by generations 3 and 4 after the wrap-around carry those stamps
+    auto* const head = static_cast<mylib::details::shm_header*>(segment);
+    head->entering_counter.store((mylib::details::shm_last_generation - 1) << mylib::details::shm_generation_shift, std::memory_order_relaxed);
+    for (const auto& [offset, stamp] : { std::pair(head->slot_offsets[0].load(), 3uz), std::pair(head->slot_offsets[1].load(), 4uz) }) {
+        auto* const cells = reinterpret_cast<cell_type*>(static_cast<std::byte*>(segment) + offset);
+        for (auto i : std::views::iota(0uz, queue_capacity)) {
+            cells[i].stamp.store(stamp, std::memory_order_relaxed);
+        }
+    }
+
+    mylib::shm_producer<std::size_t> producer(queue.native_handle());
+    std::size_t sent = 0;
+    std::size_t received = 0;
+    std::size_t mismatched = 0;
+    for (auto round : std::views::iota(0uz, rounds)) {
+        // 0 is what an unwritten cell holds, never send it
+        const auto first = sent + 1;
+        const auto count = round_messages + round;
+        sent += count;
+        std::atomic_bool writing = false;
+        std::jthread sender([&producer, &writing, first, count] {
+            for (auto j : std::views::iota(0uz, count - 1)) {
+                while (!producer.enqueue(first + j)) {
+                    std::this_thread::yield();
+                }
+            }
+            while (!producer.publish([&writing, first, count](std::size_t& v) noexcept {
+                writing.store(true, std::memory_order_relaxed);
+                std::this_thread::sleep_for(5ms);
+                v = first + count - 1;
+            })) {
+                std::this_thread::yield();
+            }
+        });
+        while (!writing.load(std::memory_order_relaxed)) {
+            std::this_thread::yield();
+        }
+        for (std::size_t k = 0; k < count;) {
+            auto values = queue.wait_for_exclusive_values();
+            for (const auto v : values) {
+                if (v != first + k) {
+                    ++mismatched;
+                }
+                ++k;
+            }
+            mismatched += values.abandoned();
+            received += values.size();
+        }
+    }
+    const auto generation = head->entering_counter.load(std::memory_order_relaxed) >> mylib::details::shm_generation_shift;
+    ::munmap(segment, segment_size);
+    std::println("Generation wrapped around to {}, messages received: {}", generation, received);
+    if (generation >= mylib::details::shm_last_generation - 1 || received != sent || mismatched != 0) {
+        std::println("Mismatch: expected {} messages in order across the wrap-around, {} wrong", sent, mismatched);
+    } else {
+        std::println("All messages received successfully across the wrap-around.");
+    }
+}
+#endif
+
 int main() {
     test_2();
+    test_3();
+    test_4();
+    test_5();
+    test_6();
+#ifdef __linux__
+    test_7();
+    for (auto backend : { mylib::io_backend::io_uring, mylib::io_backend::epoll }) {
+        try {
+            test_8(backend);
+        } catch (const std::system_error& e) {
+            std::println("I/O backend unavailable: {}", e.what());
+        }
+    }
+    test_9();
+#endif
+    if constexpr (mylib::trace::enabled) {
+        std::ofstream trace_file("trace.json");
+        mylib::trace::dump_chrome_trace(trace_file);
+    }
 }
@@ -4,6 +4,15 @@ add_files("src/*.cpp")
 add_includedirs("include")
 set_encodings("utf-8")
 
+option("trace")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Record queue events and dump them as Chrome trace JSON")
+    add_defines("MYLIB_TRACE")
+option_end()
+
+add_options("trace")
+
 target("llvm")
     set_kind("binary")
     set_toolchains("clang")